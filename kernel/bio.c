@@ -8,6 +8,8 @@
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
+//     On a device with the write-back cache on, bwrite only marks
+//     the buffer dirty; bflush makes such writes durable.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -60,6 +62,16 @@ binit(void)
   #endif
 }
 
+// Write b to the disk if it is dirty. Must be locked.
+static void
+bclean(struct buf *b)
+{
+  if(b->dirty){
+    disk_write(b);
+    b->dirty = 0;
+  }
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
@@ -68,6 +80,7 @@ bget(uint dev, uint sectorno)
 {
   struct buf *b;
 
+again:
   acquire(&bcache.lock);
 
   // Is the block already cached?
@@ -81,9 +94,9 @@ bget(uint dev, uint sectorno)
   }
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
+  // Recycle the least recently used (LRU) unused clean buffer.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
+    if(b->refcnt == 0 && !b->dirty) {
       b->dev = dev;
       b->sectorno = sectorno;
       b->valid = 0;
@@ -93,6 +106,20 @@ bget(uint dev, uint sectorno)
       return b;
     }
   }
+
+  // All unused buffers are dirty. Write back the LRU one under
+  // its old identity, so nobody reads a stale copy from the disk
+  // meanwhile, then look again.
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->refcnt == 0) {
+      b->refcnt = 1;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      bclean(b);
+      brelse(b);
+      goto again;
+    }
+  }
   panic("bget: no buffers");
 }
 
@@ -105,6 +132,8 @@ bread(uint dev, uint sectorno) {
   if (!b->valid) {
     disk_read(b);
     b->valid = 1;
+  } else {
+    disk_cachehit(dev);
   }
 
   return b;
@@ -115,7 +144,34 @@ void
 bwrite(struct buf *b) {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  disk_write(b);
+  if(disk_wbcache(b->dev))
+    b->dirty = 1;
+  else
+    disk_write(b);
+}
+
+// Write every dirty buffer of dev back, then have the device
+// flush its own cache. All writes that completed before the call
+// are durable when it returns.
+void
+bflush(uint dev)
+{
+  struct buf *b;
+
+again:
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->dirty){
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      bclean(b);
+      brelse(b);
+      goto again;
+    }
+  }
+  release(&bcache.lock);
+  disk_flush(dev);
 }
 
 // Release a locked buffer.
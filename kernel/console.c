@@ -52,16 +52,20 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  int i, j, m;
+  char buf[32];
+
+  // not copied under cons.lock: the user's page may have
+  // to be swapped in, which sleeps
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(buf) ? n - i : sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    sbi_console_putchar(c);
+    acquire(&cons.lock);
+    for(j = 0; j < m; j++)
+      sbi_console_putchar(buf[j]);
+    release(&cons.lock);
   }
-  release(&cons.lock);
 
   return i;
 }
@@ -77,8 +81,12 @@ consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
   int c;
-  char cbuf;
+  char cbuf[INPUT_BUF];
 
+  // the line is gathered in cbuf and copied out once cons.lock
+  // is released, since the user's page may have to be swapped in
+  if(n > INPUT_BUF)
+    n = INPUT_BUF;
   target = n;
   acquire(&cons.lock);
   while(n > 0){
@@ -103,12 +111,8 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
 
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
+    // copy the input byte to the line buffer.
+    cbuf[target - n] = c;
     --n;
 
     if(c == '\n'){
@@ -119,6 +123,8 @@ consoleread(int user_dst, uint64 dst, int n)
   }
   release(&cons.lock);
 
+  if(either_copyout(user_dst, dst, cbuf, target - n) == -1)
+    return -1;
   return target - n;
 }
 
@@ -2,48 +2,272 @@
 #include "include/param.h"
 #include "include/memlayout.h"
 #include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/timer.h"
+#include "include/string.h"
+#include "include/printf.h"
 
 #include "include/buf.h"
+#include "include/disk.h"
+#include "include/ramdisk.h"
 
 #ifndef QEMU
 #include "include/sdcard.h"
 #include "include/dmac.h"
+#include "include/plic.h"
 #else
 #include "include/virtio.h"
 #endif 
 
+// Registry of block devices. A buf's dev is an index into it.
+// Drivers register while the kernel boots on hart 0, the table
+// is only read afterwards, so it needs no lock of its own.
+static struct {
+    struct blkdev dev[NDISK];
+    int ndisk;
+} blk;
+
+#ifndef QEMU
+static void sdcard_rw(struct blkdev *bd, struct buf *b, int write)
+{
+    if (write)
+        sdcard_write_sector(b->data, b->sectorno);
+    else
+        sdcard_read_sector(b->data, b->sectorno);
+}
+
+static void sdcard_intr(struct blkdev *bd)
+{
+    dmac_intr(DMAC_CHANNEL0);
+}
+
+static struct blkdev_ops sdcard_ops = {
+    .rw = sdcard_rw,
+    .intr = sdcard_intr,
+};
+#endif
+
 void disk_init(void)
 {
     #ifdef QEMU
     virtio_disk_init();
 	#else 
 	sdcard_init();
+    // the driver serializes requests itself and can't tell its size
+    disk_register("sdcard", &sdcard_ops, 0, 0, 1, DISK_IRQ);
     #endif
+    ramdisk_init();
+    if (blk.ndisk == 0)
+        panic("disk_init: no disk");
+}
+
+/**
+ * Attach a block device.
+ * @param   capacity    size in sectors, 0 if unknown
+ * @param   qdepth      requests the driver accepts at a time
+ * @param   irq         PLIC source routed to ops->intr, 0 if none
+ * @return  the device number, -1 if the registry is full
+ */
+int disk_register(char *name, struct blkdev_ops *ops, void *priv,
+                  uint64 capacity, int qdepth, int irq)
+{
+    struct blkdev *bd;
+
+    if (blk.ndisk >= NDISK)
+        return -1;
+    bd = &blk.dev[blk.ndisk];
+    safestrcpy(bd->name, name, sizeof(bd->name));
+    bd->ops = ops;
+    bd->priv = priv;
+    bd->capacity = capacity;
+    bd->qdepth = qdepth > 0 ? qdepth : 1;
+    bd->irq = irq;
+    initlock(&bd->lock, "blkdev");
+    printf("disk%d: %s, %d sectors\n", blk.ndisk, name, (int)capacity);
+    return blk.ndisk++;
+}
+
+static struct blkdev *getdev(uint dev)
+{
+    if (dev >= blk.ndisk)
+        panic("disk: no such device");
+    return &blk.dev[dev];
+}
+
+// Wait for a free slot in bd's queue, then account the request.
+static uint64 disk_start(struct blkdev *bd)
+{
+    uint64 now;
+
+    acquire(&bd->lock);
+    while (bd->st.in_flight >= bd->qdepth)
+        sleep(bd, &bd->lock);
+    now = r_time();
+    if (bd->st.in_flight++ == 0)
+        bd->busy_since = now;
+    release(&bd->lock);
+    return now;
+}
+
+static void disk_done(struct blkdev *bd, int write, uint64 start)
+{
+    uint64 now = r_time();
+    struct iostat *st = &bd->st;
+
+    acquire(&bd->lock);
+    if (write) {
+        st->writes++;
+        st->wsectors++;
+    } else {
+        st->reads++;
+        st->rsectors++;
+    }
+    if (--st->in_flight == 0)
+        st->busy += TIME2US(now - bd->busy_since);
+    if (write)
+        bd->unflushed = 1;
+    lathist_add(&st->lat[write], TIME2US(now - start));
+    wakeup(bd);
+    release(&bd->lock);
+}
+
+static void disk_rw(struct buf *b, int write)
+{
+    struct blkdev *bd = getdev(b->dev);
+    uint64 start = disk_start(bd);
+
+    bd->ops->rw(bd, b, write);
+    disk_done(bd, write, start);
 }
 
 void disk_read(struct buf *b)
 {
-    #ifdef QEMU
-	virtio_disk_rw(b, 0);
-    #else 
-	sdcard_read_sector(b->data, b->sectorno);
-	#endif
+    disk_rw(b, 0);
 }
 
 void disk_write(struct buf *b)
 {
-    #ifdef QEMU
-	virtio_disk_rw(b, 1);
-    #else 
-	sdcard_write_sector(b->data, b->sectorno);
-	#endif
+    disk_rw(b, 1);
 }
 
-void disk_intr(void)
+// Barrier: returns once every write that completed before the
+// call is durable. Cheap when nothing was written since the last one.
+void disk_flush(uint dev)
 {
-    #ifdef QEMU
-    virtio_disk_intr();
-    #else 
-    dmac_intr(DMAC_CHANNEL0);
-    #endif
+    struct blkdev *bd = getdev(dev);
+    int need;
+
+    acquire(&bd->lock);
+    need = bd->unflushed;
+    bd->unflushed = 0;
+    release(&bd->lock);
+    if (!need || bd->ops->flush == 0)
+        return;
+    bd->ops->flush(bd);
+    acquire(&bd->lock);
+    bd->st.flushes++;
+    release(&bd->lock);
+}
+
+// Whether bwrite() may leave buffers of dev dirty in the cache.
+int disk_wbcache(uint dev)
+{
+    return getdev(dev)->wbcache;
+}
+
+// Turn the write-back buffer cache of dev on or off, on < 0 only
+// queries. Returns the old setting, -1 if there is no such device.
+// Caller bflush()es after turning it off.
+int disk_setwbcache(int dev, int on)
+{
+    int old;
+
+    if (dev < 0 || dev >= blk.ndisk)
+        return -1;
+    old = blk.dev[dev].wbcache;
+    if (on >= 0)
+        blk.dev[dev].wbcache = (on != 0);
+    return old;
+}
+
+// Hand a PLIC interrupt to the driver that owns it.
+// Returns 1 if some device took it, 0 otherwise.
+int disk_intr(int irq)
+{
+    int handled = 0;
+
+    for (int i = 0; i < blk.ndisk; i++) {
+        struct blkdev *bd = &blk.dev[i];
+        if (bd->irq == irq && bd->ops->intr) {
+            bd->ops->intr(bd);
+            handled = 1;
+        }
+    }
+    return handled;
+}
+
+// A bread() satisfied by the buffer cache.
+void disk_cachehit(uint dev)
+{
+    struct blkdev *bd = getdev(dev);
+
+    acquire(&bd->lock);
+    bd->st.cached++;
+    release(&bd->lock);
+}
+
+// Copy out the statistics of device dev.
+// Returns -1 if there is no such device.
+int disk_getstat(int dev, struct iostat *st)
+{
+    if (dev < 0 || dev >= blk.ndisk)
+        return -1;
+    struct blkdev *bd = &blk.dev[dev];
+    acquire(&bd->lock);
+    *st = bd->st;
+    release(&bd->lock);
+    return 0;
+}
+
+int disk_getinfo(int dev, struct blkinfo *info)
+{
+    if (dev < 0 || dev >= blk.ndisk)
+        return -1;
+    struct blkdev *bd = &blk.dev[dev];
+    memmove(info->name, bd->name, sizeof(info->name));
+    info->capacity = bd->capacity;
+    info->qdepth = bd->qdepth;
+    return 0;
+}
+
+// Set the polling budget of dev, see virtio_disk.c.
+// Returns the old budget, or -1 if dev can't poll.
+int disk_setpoll(int dev, int us)
+{
+    if (dev < 0 || dev >= blk.ndisk || blk.dev[dev].ops->setpoll == 0)
+        return -1;
+    return blk.dev[dev].ops->setpoll(&blk.dev[dev], us);
+}
+
+int disk_pollstat(int dev, struct pollstat *st)
+{
+    if (dev < 0 || dev >= blk.ndisk || blk.dev[dev].ops->pollstat == 0)
+        return -1;
+    blk.dev[dev].ops->pollstat(&blk.dev[dev], st);
+    return 0;
+}
+
+// Account one request of us microseconds in a log2 histogram.
+// Caller serializes access to h.
+void lathist_add(struct lathist *h, uint64 us)
+{
+    int i = 0;
+    h->count++;
+    h->total += us;
+    while (us > 1 && i < NLATBKT - 1) {
+        us >>= 1;
+        i++;
+    }
+    h->bkt[i]++;
 }
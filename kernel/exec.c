@@ -10,37 +10,13 @@
 #include "include/fat32.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
+#include "include/vma.h"
 #include "include/printf.h"
 #include "include/string.h"
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct dirent *ep, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-  if((va % PGSIZE) != 0)
-    panic("loadseg: va must be page aligned");
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == NULL)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(eread(ep, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-
-  return 0;
-}
-
-
+// Program segments aren't read in here. Each one is recorded as a
+// vma, and uvmfault() reads its pages from the file as the program
+// first touches them.
 int exec(char *path, char **argv)
 {
   char *s, *last;
@@ -50,19 +26,9 @@ int exec(char *path, char **argv)
   struct dirent *ep;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  pagetable_t kpagetable = 0, oldkpagetable;
+  struct vma *vma = 0;
   struct proc *p = myproc();
 
-  // Make a copy of p->kpt without old user space, 
-  // but with the same kstack we are using now, which can't be changed
-  if ((kpagetable = (pagetable_t)kalloc()) == NULL) {
-    return -1;
-  }
-  memmove(kpagetable, p->kpagetable, PGSIZE);
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    kpagetable[i] = 0;
-  }
-
   if((ep = ename(path)) == NULL) {
     #ifdef DEBUG
     printf("[exec] %s not found\n", path);
@@ -89,14 +55,11 @@ int exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, kpagetable, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
-    sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz || ph.vaddr + ph.memsz > MAXUVA)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ep, ph.off, ph.filesz) < 0)
+    if(vmaadd(&vma, ph.vaddr, ph.vaddr + ph.memsz, ep, ph.off, ph.filesz, 0, 0) < 0)
       goto bad;
+    sz = ph.vaddr + ph.memsz;
   }
   eunlock(ep);
   eput(ep);
@@ -109,7 +72,7 @@ int exec(char *path, char **argv)
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, kpagetable, sz, sz + 2*PGSIZE)) == 0)
+  if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
   uvmclear(pagetable, sz-2*PGSIZE);
@@ -149,18 +112,22 @@ int exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // Write back and drop the old image's mmap() regions.
+  uvmmunmap(p, 0, MAXUVA);
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
-  oldkpagetable = p->kpagetable;
   p->pagetable = pagetable;
-  p->kpagetable = kpagetable;
   p->sz = sz;
+  vmafree(&p->vma);
+  p->vma = vma;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  // we're running on the old page table; leave it before freeing it.
+  // A fresh ASID can have no stale TLB entries on any hart.
+  p->asid = 0;
+  uvmswitch(p);
   proc_freepagetable(oldpagetable, oldsz);
-  w_satp(MAKE_SATP(p->kpagetable));
-  sfence_vma();
-  kvmfree(oldkpagetable, 0);
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -169,8 +136,7 @@ int exec(char *path, char **argv)
   #endif
   if(pagetable)
     proc_freepagetable(pagetable, sz);
-  if(kpagetable)
-    kvmfree(kpagetable, 0);
+  vmafree(&vma);
   if(ep){
     eunlock(ep);
     eput(ep);
@@ -9,6 +9,9 @@
 #include "include/fat32.h"
 #include "include/string.h"
 #include "include/printf.h"
+#include "include/disk.h"
+#include "include/kmalloc.h"
+#include "include/pcache.h"
 
 /* fields that start with "_" are something we don't use */
 
@@ -43,7 +46,10 @@ union dentry {
     long_name_entry_t   lne;
 };
 
-static struct {
+// One per block device, indexed by dev. A volume is mounted
+// while root.valid is 1.
+static struct fat {
+    uint8   dev;
     uint32  first_data_sec;
     uint32  data_sec_cnt;
     uint32  data_clus_cnt;
@@ -60,84 +66,206 @@ static struct {
         uint32  root_clus;
     } bpb;
 
-} fat;
+    struct dirent root;         // root directory of the volume
+    struct dirent *mnt;         // directory it covers, 0 for the root volume
+} fats[NDISK];
 
+// Entries are kmalloc()ed on demand. Once there are ENTRY_CACHE_NUM
+// of them unused ones get recycled, and the cache only grows past
+// that when every entry is in use.
 static struct entry_cache {
     struct spinlock lock;
-    struct dirent entries[ENTRY_CACHE_NUM];
+    int nentry;
+
+    // LRU list of entries, through prev/next.
+    // head.next is most recent, head.prev is least.
+    struct dirent head;
 } ecache;
 
-static struct dirent root;
+// serializes mount() and umount()
+static struct sleeplock mount_lock;
+
+static inline struct fat *efat(struct dirent *ep)
+{
+    return &fats[ep->dev];
+}
+
+static inline int isroot(struct dirent *ep)
+{
+    return ep == &efat(ep)->root;
+}
 
 /**
- * Read the Boot Parameter Block.
+ * Read the Boot Parameter Block of dev and set up the volume root.
  * @return  0       if success
- *          -1      if fail
+ *          -1      if dev doesn't hold a usable FAT32 volume
  */
-int fat32_init()
+static int fat_load(struct fat *fat, uint8 dev)
 {
-    #ifdef DEBUG
-    printf("[fat32_init] enter!\n");
-    #endif
-    struct buf *b = bread(0, 0);
-    if (strncmp((char const*)(b->data + 82), "FAT32", 5))
-        panic("not FAT32 volume");
-    // fat.bpb.byts_per_sec = *(uint16 *)(b->data + 11);
-    memmove(&fat.bpb.byts_per_sec, b->data + 11, 2);            // avoid misaligned load on k210
-    fat.bpb.sec_per_clus = *(b->data + 13);
-    fat.bpb.rsvd_sec_cnt = *(uint16 *)(b->data + 14);
-    fat.bpb.fat_cnt = *(b->data + 16);
-    fat.bpb.hidd_sec = *(uint32 *)(b->data + 28);
-    fat.bpb.tot_sec = *(uint32 *)(b->data + 32);
-    fat.bpb.fat_sz = *(uint32 *)(b->data + 36);
-    fat.bpb.root_clus = *(uint32 *)(b->data + 44);
-    fat.first_data_sec = fat.bpb.rsvd_sec_cnt + fat.bpb.fat_cnt * fat.bpb.fat_sz;
-    fat.data_sec_cnt = fat.bpb.tot_sec - fat.first_data_sec;
-    fat.data_clus_cnt = fat.data_sec_cnt / fat.bpb.sec_per_clus;
-    fat.byts_per_clus = fat.bpb.sec_per_clus * fat.bpb.byts_per_sec;
+    struct buf *b = bread(dev, 0);
+    if (strncmp((char const*)(b->data + 82), "FAT32", 5)) {
+        brelse(b);
+        return -1;
+    }
+    fat->dev = dev;
+    // fat->bpb.byts_per_sec = *(uint16 *)(b->data + 11);
+    memmove(&fat->bpb.byts_per_sec, b->data + 11, 2);            // avoid misaligned load on k210
+    fat->bpb.sec_per_clus = *(b->data + 13);
+    fat->bpb.rsvd_sec_cnt = *(uint16 *)(b->data + 14);
+    fat->bpb.fat_cnt = *(b->data + 16);
+    fat->bpb.hidd_sec = *(uint32 *)(b->data + 28);
+    fat->bpb.tot_sec = *(uint32 *)(b->data + 32);
+    fat->bpb.fat_sz = *(uint32 *)(b->data + 36);
+    fat->bpb.root_clus = *(uint32 *)(b->data + 44);
+    fat->first_data_sec = fat->bpb.rsvd_sec_cnt + fat->bpb.fat_cnt * fat->bpb.fat_sz;
+    fat->data_sec_cnt = fat->bpb.tot_sec - fat->first_data_sec;
+    fat->data_clus_cnt = fat->data_sec_cnt / fat->bpb.sec_per_clus;
+    fat->byts_per_clus = fat->bpb.sec_per_clus * fat->bpb.byts_per_sec;
     brelse(b);
 
     #ifdef DEBUG
-    printf("[FAT32 init]byts_per_sec: %d\n", fat.bpb.byts_per_sec);
-    printf("[FAT32 init]root_clus: %d\n", fat.bpb.root_clus);
-    printf("[FAT32 init]sec_per_clus: %d\n", fat.bpb.sec_per_clus);
-    printf("[FAT32 init]fat_cnt: %d\n", fat.bpb.fat_cnt);
-    printf("[FAT32 init]fat_sz: %d\n", fat.bpb.fat_sz);
-    printf("[FAT32 init]first_data_sec: %d\n", fat.first_data_sec);
+    printf("[FAT32 init]dev: %d\n", dev);
+    printf("[FAT32 init]byts_per_sec: %d\n", fat->bpb.byts_per_sec);
+    printf("[FAT32 init]root_clus: %d\n", fat->bpb.root_clus);
+    printf("[FAT32 init]sec_per_clus: %d\n", fat->bpb.sec_per_clus);
+    printf("[FAT32 init]fat_cnt: %d\n", fat->bpb.fat_cnt);
+    printf("[FAT32 init]fat_sz: %d\n", fat->bpb.fat_sz);
+    printf("[FAT32 init]first_data_sec: %d\n", fat->first_data_sec);
     #endif
 
     // make sure that byts_per_sec has the same value with BSIZE 
-    if (BSIZE != fat.bpb.byts_per_sec) 
-        panic("byts_per_sec != BSIZE");
+    if (BSIZE != fat->bpb.byts_per_sec) 
+        return -1;
+    memset(&fat->root, 0, sizeof(fat->root));
+    initsleeplock(&fat->root.lock, "entry");
+    fat->root.attribute = (ATTR_DIRECTORY | ATTR_SYSTEM);
+    fat->root.first_clus = fat->root.cur_clus = fat->bpb.root_clus;
+    fat->root.dev = dev;
+    fat->root.valid = 1;
+    return 0;
+}
+
+/**
+ * Set up the entry cache and load the root volume.
+ * @return  0       if success
+ */
+int fat32_init()
+{
+    #ifdef DEBUG
+    printf("[fat32_init] enter!\n");
+    #endif
     initlock(&ecache.lock, "ecache");
-    memset(&root, 0, sizeof(root));
-    initsleeplock(&root.lock, "entry");
-    root.attribute = (ATTR_DIRECTORY | ATTR_SYSTEM);
-    root.first_clus = root.cur_clus = fat.bpb.root_clus;
-    root.valid = 1;
-    root.prev = &root;
-    root.next = &root;
-    for(struct dirent *de = ecache.entries; de < ecache.entries + ENTRY_CACHE_NUM; de++) {
-        de->dev = 0;
-        de->valid = 0;
-        de->ref = 0;
-        de->dirty = 0;
-        de->parent = 0;
-        de->next = root.next;
-        de->prev = &root;
-        initsleeplock(&de->lock, "entry");
-        root.next->prev = de;
-        root.next = de;
+    initsleeplock(&mount_lock, "mount");
+    ecache.head.prev = &ecache.head;
+    ecache.head.next = &ecache.head;
+    ecache.nentry = 0;
+    if (fat_load(&fats[ROOTDEV], ROOTDEV) < 0)
+        panic("not FAT32 volume");
+    pcinit();
+    return 0;
+}
+
+/**
+ * Mount the volume on dev over the directory dp.
+ * Keeps the caller's reference to dp on success.
+ * @return  0       if success
+ *          -1      if fail
+ */
+int fat32_mount(int dev, struct dirent *dp)
+{
+    struct blkinfo info;
+    struct fat *fat;
+
+    if (disk_getinfo(dev, &info) < 0 || !(dp->attribute & ATTR_DIRECTORY) || isroot(dp))
+        return -1;
+    fat = &fats[dev];
+    acquiresleep(&mount_lock);
+    if (fat->root.valid || dp->mount || fat_load(fat, dev) < 0) {
+        releasesleep(&mount_lock);
+        return -1;
     }
+    acquire(&ecache.lock);
+    fat->mnt = dp;
+    dp->mount = &fat->root;
+    release(&ecache.lock);
+    releasesleep(&mount_lock);
     return 0;
 }
 
+/**
+ * Unmount the volume whose root is ep, which must be the only
+ * entry of the volume still in use. Takes over the caller's
+ * reference to ep on success.
+ * @return  0       if success
+ *          -1      if ep isn't a mounted root or the volume is busy
+ */
+int fat32_umount(struct dirent *ep)
+{
+    struct fat *fat = efat(ep);
+    struct dirent *de, *mnt;
+
+    if (!isroot(ep) || fat->mnt == 0)
+        return -1;
+    acquiresleep(&mount_lock);
+    acquire(&ecache.lock);
+    if (ep->ref > 1)
+        goto busy;
+    for (de = ecache.head.next; de != &ecache.head; de = de->next) {
+        if (de->dev == fat->dev && de->ref > 0)
+            goto busy;
+    }
+    // unused entries are clean, eput() wrote them back
+    for (de = ecache.head.next; de != &ecache.head; de = de->next) {
+        if (de->dev == fat->dev)
+            de->valid = 0;
+    }
+    mnt = fat->mnt;
+    mnt->mount = 0;
+    fat->mnt = 0;
+    ep->ref = 0;
+    ep->valid = 0;
+    release(&ecache.lock);
+    releasesleep(&mount_lock);
+    bflush(fat->dev);
+    eput(mnt);
+    return 0;
+
+busy:
+    release(&ecache.lock);
+    releasesleep(&mount_lock);
+    return -1;
+}
+
+// The directory a mounted volume root covers; any other entry
+// maps to itself. Walking up through this crosses mount points.
+struct dirent *emntpoint(struct dirent *ep)
+{
+    if (isroot(ep) && efat(ep)->mnt)
+        return efat(ep)->mnt;
+    return ep;
+}
+
+// If a volume is mounted on ep, trade ep for the root of that volume.
+static struct dirent *ecross(struct dirent *ep)
+{
+    struct dirent *root;
+
+    acquire(&ecache.lock);
+    if ((root = ep->mount) != 0)
+        root->ref++;
+    release(&ecache.lock);
+    if (root == 0)
+        return ep;
+    eput(ep);
+    return root;
+}
+
 /**
  * @param   cluster   cluster number starts from 2, which means no 0 and 1
  */
-static inline uint32 first_sec_of_clus(uint32 cluster)
+static inline uint32 first_sec_of_clus(struct fat *fat, uint32 cluster)
 {
-    return ((cluster - 2) * fat.bpb.sec_per_clus) + fat.first_data_sec;
+    return ((cluster - 2) * fat->bpb.sec_per_clus) + fat->first_data_sec;
 }
 
 /**
@@ -145,36 +273,36 @@ static inline uint32 first_sec_of_clus(uint32 cluster)
  * @param   cluster     number of a data cluster
  * @param   fat_num     number of FAT table from 1, shouldn't be larger than bpb::fat_cnt
  */
-static inline uint32 fat_sec_of_clus(uint32 cluster, uint8 fat_num)
+static inline uint32 fat_sec_of_clus(struct fat *fat, uint32 cluster, uint8 fat_num)
 {
-    return fat.bpb.rsvd_sec_cnt + (cluster << 2) / fat.bpb.byts_per_sec + fat.bpb.fat_sz * (fat_num - 1);
+    return fat->bpb.rsvd_sec_cnt + (cluster << 2) / fat->bpb.byts_per_sec + fat->bpb.fat_sz * (fat_num - 1);
 }
 
 /**
  * For the given number of a data cluster, return the offest in the corresponding sector in a FAT table.
  * @param   cluster   number of a data cluster
  */
-static inline uint32 fat_offset_of_clus(uint32 cluster)
+static inline uint32 fat_offset_of_clus(struct fat *fat, uint32 cluster)
 {
-    return (cluster << 2) % fat.bpb.byts_per_sec;
+    return (cluster << 2) % fat->bpb.byts_per_sec;
 }
 
 /**
  * Read the FAT table content corresponded to the given cluster number.
  * @param   cluster     the number of cluster which you want to read its content in FAT table
  */
-static uint32 read_fat(uint32 cluster)
+static uint32 read_fat(struct fat *fat, uint32 cluster)
 {
     if (cluster >= FAT32_EOC) {
         return cluster;
     }
-    if (cluster > fat.data_clus_cnt + 1) {     // because cluster number starts at 2, not 0
+    if (cluster > fat->data_clus_cnt + 1) {     // because cluster number starts at 2, not 0
         return 0;
     }
-    uint32 fat_sec = fat_sec_of_clus(cluster, 1);
+    uint32 fat_sec = fat_sec_of_clus(fat, cluster, 1);
     // here should be a cache layer for FAT table, but not implemented yet.
-    struct buf *b = bread(0, fat_sec);
-    uint32 next_clus = *(uint32 *)(b->data + fat_offset_of_clus(cluster));
+    struct buf *b = bread(fat->dev, fat_sec);
+    uint32 next_clus = *(uint32 *)(b->data + fat_offset_of_clus(fat, cluster));
     brelse(b);
     return next_clus;
 }
@@ -184,47 +312,47 @@ static uint32 read_fat(uint32 cluster)
  * @param   cluster     the number of cluster to write its content in FAT table
  * @param   content     the content which should be the next cluster number of FAT end of chain flag
  */
-static int write_fat(uint32 cluster, uint32 content)
+static int write_fat(struct fat *fat, uint32 cluster, uint32 content)
 {
-    if (cluster > fat.data_clus_cnt + 1) {
+    if (cluster > fat->data_clus_cnt + 1) {
         return -1;
     }
-    uint32 fat_sec = fat_sec_of_clus(cluster, 1);
-    struct buf *b = bread(0, fat_sec);
-    uint off = fat_offset_of_clus(cluster);
+    uint32 fat_sec = fat_sec_of_clus(fat, cluster, 1);
+    struct buf *b = bread(fat->dev, fat_sec);
+    uint off = fat_offset_of_clus(fat, cluster);
     *(uint32 *)(b->data + off) = content;
     bwrite(b);
     brelse(b);
     return 0;
 }
 
-static void zero_clus(uint32 cluster)
+static void zero_clus(struct fat *fat, uint32 cluster)
 {
-    uint32 sec = first_sec_of_clus(cluster);
+    uint32 sec = first_sec_of_clus(fat, cluster);
     struct buf *b;
-    for (int i = 0; i < fat.bpb.sec_per_clus; i++) {
-        b = bread(0, sec++);
+    for (int i = 0; i < fat->bpb.sec_per_clus; i++) {
+        b = bread(fat->dev, sec++);
         memset(b->data, 0, BSIZE);
         bwrite(b);
         brelse(b);
     }
 }
 
-static uint32 alloc_clus(uint8 dev)
+static uint32 alloc_clus(struct fat *fat)
 {
     // should we keep a free cluster list? instead of searching fat every time.
     struct buf *b;
-    uint32 sec = fat.bpb.rsvd_sec_cnt;
-    uint32 const ent_per_sec = fat.bpb.byts_per_sec / sizeof(uint32);
-    for (uint32 i = 0; i < fat.bpb.fat_sz; i++, sec++) {
-        b = bread(dev, sec);
+    uint32 sec = fat->bpb.rsvd_sec_cnt;
+    uint32 const ent_per_sec = fat->bpb.byts_per_sec / sizeof(uint32);
+    for (uint32 i = 0; i < fat->bpb.fat_sz; i++, sec++) {
+        b = bread(fat->dev, sec);
         for (uint32 j = 0; j < ent_per_sec; j++) {
             if (((uint32 *)(b->data))[j] == 0) {
                 ((uint32 *)(b->data))[j] = FAT32_EOC + 7;
                 bwrite(b);
                 brelse(b);
                 uint32 clus = i * ent_per_sec + j;
-                zero_clus(clus);
+                zero_clus(fat, clus);
                 return clus;
             }
         }
@@ -233,23 +361,23 @@ static uint32 alloc_clus(uint8 dev)
     panic("no clusters");
 }
 
-static void free_clus(uint32 cluster)
+static void free_clus(struct fat *fat, uint32 cluster)
 {
-    write_fat(cluster, 0);
+    write_fat(fat, cluster, 0);
 }
 
-static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off, uint n)
+static uint rw_clus(struct fat *fat, uint32 cluster, int write, int user, uint64 data, uint off, uint n)
 {
-    if (off + n > fat.byts_per_clus)
+    if (off + n > fat->byts_per_clus)
         panic("offset out of range");
     uint tot, m;
     struct buf *bp;
-    uint sec = first_sec_of_clus(cluster) + off / fat.bpb.byts_per_sec;
-    off = off % fat.bpb.byts_per_sec;
+    uint sec = first_sec_of_clus(fat, cluster) + off / fat->bpb.byts_per_sec;
+    off = off % fat->bpb.byts_per_sec;
 
     int bad = 0;
     for (tot = 0; tot < n; tot += m, off += m, data += m, sec++) {
-        bp = bread(0, sec);
+        bp = bread(fat->dev, sec);
         m = BSIZE - off % BSIZE;
         if (n - tot < m) {
             m = n - tot;
@@ -278,13 +406,14 @@ static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off,
  */
 static int reloc_clus(struct dirent *entry, uint off, int alloc)
 {
-    int clus_num = off / fat.byts_per_clus;
+    struct fat *fat = efat(entry);
+    int clus_num = off / fat->byts_per_clus;
     while (clus_num > entry->clus_cnt) {
-        int clus = read_fat(entry->cur_clus);
+        int clus = read_fat(fat, entry->cur_clus);
         if (clus >= FAT32_EOC) {
             if (alloc) {
-                clus = alloc_clus(entry->dev);
-                write_fat(entry->cur_clus, clus);
+                clus = alloc_clus(fat);
+                write_fat(fat, entry->cur_clus, clus);
             } else {
                 entry->cur_clus = entry->first_clus;
                 entry->clus_cnt = 0;
@@ -298,17 +427,61 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
         entry->cur_clus = entry->first_clus;
         entry->clus_cnt = 0;
         while (entry->clus_cnt < clus_num) {
-            entry->cur_clus = read_fat(entry->cur_clus);
+            entry->cur_clus = read_fat(fat, entry->cur_clus);
             if (entry->cur_clus >= FAT32_EOC) {
                 panic("reloc_clus");
             }
             entry->clus_cnt++;
         }
     }
-    return off % fat.byts_per_clus;
+    return off % fat->byts_per_clus;
+}
+
+// Move n bytes at off of entry's data between its clusters and
+// data, which is a user address if user is 1. A write must stay
+// within the clusters the file has.
+static uint erw(struct dirent *entry, int write, int user, uint64 data, uint off, uint n)
+{
+    struct fat *fat = efat(entry);
+    uint tot, m;
+    for (tot = 0; tot < n; tot += m, off += m, data += m) {
+        if (entry->cur_clus >= FAT32_EOC || reloc_clus(entry, off, 0) < 0) {
+            break;
+        }
+        m = fat->byts_per_clus - off % fat->byts_per_clus;
+        if (n - tot < m) {
+            m = n - tot;
+        }
+        if (rw_clus(fat, entry->cur_clus, write, user, data, off % fat->byts_per_clus, m) != m) {
+            break;
+        }
+    }
+    return tot;
+}
+
+/**
+ * Read or write the page of entry's file at off for the page cache.
+ * Only the part inside the file goes to or from the disk; reading
+ * zeroes the rest of data.
+ * Caller must hold entry->lock.
+ * @return  0       if success
+ *          -1      if the disk transfer fell short
+ */
+int epageio(struct dirent *entry, uint off, char *data, int write)
+{
+    uint n = 0;
+    if (off < entry->file_size) {
+        n = entry->file_size - off < PGSIZE ? entry->file_size - off : PGSIZE;
+    }
+    if (!write) {
+        memset(data + n, 0, PGSIZE - n);
+    }
+    return erw(entry, write, 0, (uint64)data, off, n) == n ? 0 : -1;
 }
 
 /* like the original readi, but "reade" is odd, let alone "writee" */
+// Reads go through the page cache; if it has no room, straight
+// to the clusters.
 // Caller must hold entry->lock.
 int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
 {
@@ -320,51 +493,102 @@ int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
     }
 
     uint tot, m;
-    for (tot = 0; entry->cur_clus < FAT32_EOC && tot < n; tot += m, off += m, dst += m) {
-        reloc_clus(entry, off, 0);
-        m = fat.byts_per_clus - off % fat.byts_per_clus;
+    struct cpage *pg;
+    for (tot = 0; tot < n; tot += m, off += m, dst += m) {
+        m = PGSIZE - off % PGSIZE;
         if (n - tot < m) {
             m = n - tot;
         }
-        if (rw_clus(entry->cur_clus, 0, user_dst, dst, off % fat.byts_per_clus, m) != m) {
+        pcreadahead(entry, off / PGSIZE);
+        if ((pg = pcget(entry, off / PGSIZE, 1)) == 0) {
+            if (erw(entry, 0, user_dst, dst, off, m) != m) {
+                break;
+            }
+            continue;
+        }
+        int bad = either_copyout(user_dst, dst, pg->data + off % PGSIZE, m);
+        pcput(pg, 0);
+        if (bad == -1) {
             break;
         }
     }
     return tot;
 }
 
+// Writes land in the page cache, which writes them back later;
+// the clusters for them are allocated right away.
 // Caller must hold entry->lock.
 int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
 {
+    struct fat *fat = efat(entry);
     if (off > entry->file_size || off + n < off || (uint64)off + n > 0xffffffff
         || (entry->attribute & ATTR_READ_ONLY)) {
         return -1;
     }
+    if (n == 0) {
+        return 0;
+    }
     if (entry->first_clus == 0) {   // so file_size if 0 too, which requests off == 0
-        entry->cur_clus = entry->first_clus = alloc_clus(entry->dev);
+        entry->cur_clus = entry->first_clus = alloc_clus(fat);
         entry->clus_cnt = 0;
         entry->dirty = 1;
     }
-    uint tot, m;
+    reloc_clus(entry, off + n - 1, 1);
+
+    uint tot, m, pgoff, inpage;
+    struct cpage *pg;
     for (tot = 0; tot < n; tot += m, off += m, src += m) {
-        reloc_clus(entry, off, 1);
-        m = fat.byts_per_clus - off % fat.byts_per_clus;
+        pgoff = off % PGSIZE;
+        m = PGSIZE - pgoff;
         if (n - tot < m) {
             m = n - tot;
         }
-        if (rw_clus(entry->cur_clus, 1, user_src, src, off % fat.byts_per_clus, m) != m) {
+        // file bytes in this page that the write leaves alone
+        // have to be read in first
+        inpage = 0;
+        if (off - pgoff < entry->file_size) {
+            inpage = entry->file_size - (off - pgoff);
+            if (inpage > PGSIZE) {
+                inpage = PGSIZE;
+            }
+        }
+        int fill = (pgoff > 0 && inpage > 0) || pgoff + m < inpage;
+        if ((pg = pcget(entry, off / PGSIZE, fill)) == 0) {
+            if (erw(entry, 1, user_src, src, off, m) != m) {
+                break;
+            }
+            continue;
+        }
+        int bad = either_copyin(pg->data + pgoff, user_src, src, m);
+        pcput(pg, bad != -1);
+        if (bad == -1) {
             break;
         }
     }
-    if(n > 0) {
-        if(off > entry->file_size) {
-            entry->file_size = off;
-            entry->dirty = 1;
-        }
+    if (off > entry->file_size) {
+        entry->file_size = off;
+        entry->dirty = 1;
     }
     return tot;
 }
 
+// Add a new, unused entry to the cache. Caller holds ecache.lock.
+static struct dirent *enew(void)
+{
+    struct dirent *de;
+
+    if ((de = kmalloc(sizeof(struct dirent))) == 0)
+        return 0;
+    memset(de, 0, sizeof(struct dirent));
+    initsleeplock(&de->lock, "entry");
+    de->next = ecache.head.next;
+    de->prev = &ecache.head;
+    ecache.head.next->prev = de;
+    ecache.head.next = de;
+    ecache.nentry++;
+    return de;
+}
+
 // Returns a dirent struct. If name is given, check ecache. It is difficult to cache entries
 // by their whole path. But when parsing a path, we open all the directories through it, 
 // which forms a linked list from the final file to the root. Thus, we use the "parent" pointer 
@@ -375,7 +599,7 @@ static struct dirent *eget(struct dirent *parent, char *name)
     struct dirent *ep;
     acquire(&ecache.lock);
     if (name) {
-        for (ep = root.next; ep != &root; ep = ep->next) {          // LRU algo
+        for (ep = ecache.head.next; ep != &ecache.head; ep = ep->next) {   // LRU algo
             if (ep->valid == 1 && ep->parent == parent
                 && strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0) {
                 if (ep->ref++ == 0) {
@@ -387,19 +611,24 @@ static struct dirent *eget(struct dirent *parent, char *name)
             }
         }
     }
-    for (ep = root.prev; ep != &root; ep = ep->prev) {              // LRU algo
-        if (ep->ref == 0) {
-            ep->ref = 1;
-            ep->dev = parent->dev;
-            ep->off = 0;
-            ep->valid = 0;
-            ep->dirty = 0;
-            release(&ecache.lock);
-            return ep;
-        }
+    if (ecache.nentry < ENTRY_CACHE_NUM && (ep = enew()) != 0)
+        goto found;
+    for (ep = ecache.head.prev; ep != &ecache.head; ep = ep->prev) {   // LRU algo
+        if (ep->ref == 0)
+            goto found;
     }
-    panic("eget: insufficient ecache");
-    return 0;
+    if ((ep = enew()) == 0)                 // all in use, grow the cache
+        panic("eget: insufficient ecache");
+found:
+    pcdrop(ep);                             // pages of the file it last held
+    ep->raseq = ep->ranext = 0;
+    ep->ref = 1;
+    ep->dev = parent->dev;
+    ep->off = 0;
+    ep->valid = 0;
+    ep->dirty = 0;
+    release(&ecache.lock);
+    return ep;
 }
 
 // trim ' ' in the head and tail, '.' in head, and test legality
@@ -481,6 +710,7 @@ uint8 cal_checksum(uchar* shortname)
  */
 void emake(struct dirent *dp, struct dirent *ep, uint off)
 {
+    struct fat *fat = efat(dp);
     if (!(dp->attribute & ATTR_DIRECTORY))
         panic("emake: not dir");
     if (off % sizeof(union dentry))
@@ -499,7 +729,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff);       // low 16 bits
         de.sne.file_size = 0;                                       // filesize is updated in eupdate()
         off = reloc_clus(dp, off, 1);
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+        rw_clus(fat, dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
     } else {
         int entcnt = (strlen(ep->filename) + CHAR_LONG_NAME - 1) / CHAR_LONG_NAME;   // count of l-n-entries, rounds up
         char shortname[CHAR_SHORT_NAME + 1];
@@ -530,7 +760,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
                 }
             }
             uint off2 = reloc_clus(dp, off, 1);
-            rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off2, sizeof(de));
+            rw_clus(fat, dp->cur_clus, 1, 0, (uint64)&de, off2, sizeof(de));
             off += sizeof(de);
         }
         memset(&de, 0, sizeof(de));
@@ -540,7 +770,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff);     // low 16 bits
         de.sne.file_size = ep->file_size;                         // filesize is updated in eupdate()
         off = reloc_clus(dp, off, 1);
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+        rw_clus(fat, dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
     }
 }
 
@@ -574,7 +804,7 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
     ep->filename[FAT32_MAX_FILENAME] = '\0';
     if (attr == ATTR_DIRECTORY) {    // generate "." and ".." for ep
         ep->attribute |= ATTR_DIRECTORY;
-        ep->cur_clus = ep->first_clus = alloc_clus(dp->dev);
+        ep->cur_clus = ep->first_clus = alloc_clus(efat(dp));
         emake(ep, ep, 0);
         emake(ep, dp, 32);
     } else {
@@ -596,39 +826,58 @@ struct dirent *edup(struct dirent *entry)
     return entry;
 }
 
-// Only update filesize and first cluster in this case.
-// caller must hold entry->parent->lock
+// Write back the cached pages, then update filesize and first
+// cluster in the directory.
+// caller must hold entry->lock and entry->parent->lock
 void eupdate(struct dirent *entry)
 {
+    if (entry->valid == 1) { pcflush(entry); }
     if (!entry->dirty || entry->valid != 1) { return; }
+    struct fat *fat = efat(entry);
+    // commit point: the data and the cluster chain must be durable
+    // before the entry that points at them.
+    bflush(entry->dev);
     uint entcnt = 0;
     uint32 off = reloc_clus(entry->parent, entry->off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off, 1);
+    rw_clus(fat, entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off, 1);
     entcnt &= ~LAST_LONG_ENTRY;
     off = reloc_clus(entry->parent, entry->off + (entcnt << 5), 0);
     union dentry de;
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&de, off, sizeof(de));
+    rw_clus(fat, entry->parent->cur_clus, 0, 0, (uint64)&de, off, sizeof(de));
     de.sne.fst_clus_hi = (uint16)(entry->first_clus >> 16);
     de.sne.fst_clus_lo = (uint16)(entry->first_clus & 0xffff);
     de.sne.file_size = entry->file_size;
-    rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+    rw_clus(fat, entry->parent->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
     entry->dirty = 0;
 }
 
+// Make entry's data and its directory entry durable.
+// caller must hold entry->lock
+void esync(struct dirent *entry)
+{
+    if (entry->parent) {
+        elock(entry->parent);
+        eupdate(entry);
+        eunlock(entry->parent);
+    }
+    bflush(entry->dev);
+}
+
 // caller must hold entry->lock
 // caller must hold entry->parent->lock
 // remove the entry in its parent directory
 void eremove(struct dirent *entry)
 {
     if (entry->valid != 1) { return; }
+    struct fat *fat = efat(entry);
     uint entcnt = 0;
     uint32 off = entry->off;
     uint32 off2 = reloc_clus(entry->parent, off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off2, 1);
+    rw_clus(fat, entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off2, 1);
     entcnt &= ~LAST_LONG_ENTRY;
     uint8 flag = EMPTY_ENTRY;
     for (int i = 0; i <= entcnt; i++) {
-        rw_clus(entry->parent->cur_clus, 1, 0, (uint64) &flag, off2, 1);
+        rw_clus(fat, entry->parent->cur_clus, 1, 0, (uint64) &flag, off2, 1);
         off += 32;
         off2 = reloc_clus(entry->parent, off, 0);
     }
@@ -639,9 +888,11 @@ void eremove(struct dirent *entry)
 // caller must hold entry->lock
 void etrunc(struct dirent *entry)
 {
+    struct fat *fat = efat(entry);
+    pcdrop(entry);
     for (uint32 clus = entry->first_clus; clus >= 2 && clus < FAT32_EOC; ) {
-        uint32 next = read_fat(clus);
-        free_clus(clus);
+        uint32 next = read_fat(fat, clus);
+        free_clus(fat, clus);
         clus = next;
     }
     entry->file_size = 0;
@@ -666,16 +917,16 @@ void eunlock(struct dirent *entry)
 void eput(struct dirent *entry)
 {
     acquire(&ecache.lock);
-    if (entry != &root && entry->valid != 0 && entry->ref == 1) {
+    if (!isroot(entry) && entry->valid != 0 && entry->ref == 1) {
         // ref == 1 means no other process can have entry locked,
         // so this acquiresleep() won't block (or deadlock).
         acquiresleep(&entry->lock);
         entry->next->prev = entry->prev;
         entry->prev->next = entry->next;
-        entry->next = root.next;
-        entry->prev = &root;
-        root.next->prev = entry;
-        root.next = entry;
+        entry->next = ecache.head.next;
+        entry->prev = &ecache.head;
+        ecache.head.next->prev = entry;
+        ecache.head.next = entry;
         release(&ecache.lock);
         if (entry->valid == -1) {       // this means some one has called eremove()
             etrunc(entry);
@@ -781,7 +1032,7 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
     int cnt = 0;
     memset(ep->filename, 0, FAT32_MAX_FILENAME + 1);
     for (int off2; (off2 = reloc_clus(dp, off, 0)) != -1; off += 32) {
-        if (rw_clus(dp->cur_clus, 0, 0, (uint64)&de, off2, 32) != 32 || de.lne.order == END_OF_ENTRY) {
+        if (rw_clus(efat(dp), dp->cur_clus, 0, 0, (uint64)&de, off2, 32) != 32 || de.lne.order == END_OF_ENTRY) {
             return -1;
         }
         if (de.lne.order == EMPTY_ENTRY) {
@@ -825,8 +1076,9 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     if (strncmp(filename, ".", FAT32_MAX_FILENAME) == 0) {
         return edup(dp);
     } else if (strncmp(filename, "..", FAT32_MAX_FILENAME) == 0) {
-        if (dp == &root) {
-            return edup(&root);
+        if (isroot(dp)) {
+            dp = emntpoint(dp);
+            return edup(isroot(dp) ? dp : dp->parent);
         }
         return edup(dp->parent);
     }
@@ -890,7 +1142,7 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
 {
     struct dirent *entry, *next;
     if (*path == '/') {
-        entry = edup(&root);
+        entry = edup(&fats[ROOTDEV].root);
     } else if (*path != '\0') {
         entry = edup(myproc()->cwd);
     } else {
@@ -914,7 +1166,7 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
         }
         eunlock(entry);
         eput(entry);
-        entry = next;
+        entry = ecross(next);
     }
     if (parent) {
         eput(entry);
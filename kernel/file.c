@@ -16,21 +16,20 @@
 #include "include/printf.h"
 #include "include/string.h"
 #include "include/vm.h"
+#include "include/kmalloc.h"
 
 struct devsw devsw[NDEV];
+
+// File structures come from kmalloc(), so there is no fixed
+// limit on open files; the lock only guards reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
-  struct file *f;
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    memset(f, 0, sizeof(struct file));
-  }
   #ifdef DEBUG
   printf("fileinit\n");
   #endif
@@ -42,16 +41,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return NULL;
+  if((f = kmalloc(sizeof(struct file))) == NULL)
+    return NULL;
+  memset(f, 0, sizeof(struct file));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -80,9 +74,8 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
   release(&ftable.lock);
+  kmfree(f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -110,6 +103,15 @@ filestat(struct file *f, uint64 addr)
       return -1;
     return 0;
   }
+  if(f->type == FD_DEVICE){
+    // for user stdio to tell the console from files and pipes
+    memset(&st, 0, sizeof(st));
+    st.dev = f->major;
+    st.type = T_DEVICE;
+    if(copyout2(addr, (char *)&st, sizeof(st)) < 0)
+      return -1;
+    return 0;
+  }
   return -1;
 }
 
@@ -133,10 +135,15 @@ fileread(struct file *f, uint64 addr, int n)
         r = devsw[f->major].read(1, addr, n);
         break;
     case FD_ENTRY:
+        // fault the buffer in first: a fault on a file-backed
+        // page would take another file's lock while we hold ours
+        if(uvmpin(addr, n, 1) < 0)
+          return -1;
         elock(f->ep);
           if((r = eread(f->ep, 1, addr, f->off, n)) > 0)
             f->off += r;
         eunlock(f->ep);
+        uvmunpin();
         break;
     default:
       panic("fileread");
@@ -162,6 +169,9 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_ENTRY){
+    // as in fileread()
+    if(uvmpin(addr, n, 0) < 0)
+      return -1;
     elock(f->ep);
     if (ewrite(f->ep, 1, addr, f->off, n) == n) {
       ret = n;
@@ -170,6 +180,7 @@ filewrite(struct file *f, uint64 addr, int n)
       ret = -1;
     }
     eunlock(f->ep);
+    uvmunpin();
   } else {
     panic("filewrite");
   }
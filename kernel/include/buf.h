@@ -8,6 +8,7 @@
 struct buf {
   int valid;
   int disk;		// does disk "own" buf? 
+  int dirty;		// written by bwrite() but not yet by the disk
   uint dev;
   uint sectorno;	// sector number 
   struct sleeplock lock;
@@ -21,5 +22,6 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bflush(uint);
 
 #endif
@@ -34,7 +34,7 @@ void timer_tick();
 void            disk_init(void);
 void            disk_read(struct buf *b);
 void            disk_write(struct buf *b);
-void            disk_intr(void);
+int             disk_intr(int irq);
 
 // exec.c
 int             exec(char*, char**);
@@ -214,8 +214,6 @@ int             copyinstr(pagetable_t, char *, uint64, uint64);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *b, int write);
-void            virtio_disk_intr(void);
 
 // plic.c
 void            plicinit(void);
@@ -2,10 +2,53 @@
 #define __DISK_H
 
 #include "buf.h"
+#include "spinlock.h"
+#include "iostat.h"
+
+struct blkdev;
+
+// Entry points a block driver hands to disk_register().
+// Only rw is mandatory. flush makes every completed write durable,
+// a driver whose writes are durable on completion leaves it 0.
+struct blkdev_ops {
+    void (*rw)(struct blkdev *bd, struct buf *b, int write);
+    void (*flush)(struct blkdev *bd);
+    void (*intr)(struct blkdev *bd);
+    int  (*setpoll)(struct blkdev *bd, int us);
+    void (*pollstat)(struct blkdev *bd, struct pollstat *st);
+};
+
+struct blkdev {
+    char name[BLKNAMESZ];
+    struct blkdev_ops *ops;
+    void *priv;                 // driver's own per-device state
+    uint64 capacity;            // in sectors, 0 if unknown
+    int irq;                    // PLIC source, 0 if none
+
+    // Request queue: at most qdepth requests are handed to the
+    // driver at once, the rest wait in the block layer.
+    struct spinlock lock;
+    int qdepth;
+    struct iostat st;
+    uint64 busy_since;          // r_time() when in_flight went 0 -> 1
+    int unflushed;              // writes completed since the last flush
+    int wbcache;                // bwrite() leaves buffers dirty in the cache
+};
 
 void disk_init(void);
+int disk_register(char *name, struct blkdev_ops *ops, void *priv,
+                  uint64 capacity, int qdepth, int irq);
 void disk_read(struct buf *b);
 void disk_write(struct buf *b);
-void disk_intr(void);
+void disk_flush(uint dev);
+int disk_wbcache(uint dev);
+int disk_setwbcache(int dev, int on);
+int disk_intr(int irq);
+void disk_cachehit(uint dev);
+int disk_getstat(int dev, struct iostat *st);
+int disk_getinfo(int dev, struct blkinfo *info);
+int disk_setpoll(int dev, int us);
+int disk_pollstat(int dev, struct pollstat *st);
+void lathist_add(struct lathist *h, uint64 us);
 
 #endif
@@ -21,7 +21,7 @@
 
 #define FAT32_MAX_FILENAME  255
 #define FAT32_MAX_PATH      260
-#define ENTRY_CACHE_NUM     50
+#define ENTRY_CACHE_NUM     50      // entries kept cached, more are added while all are busy
 
 struct dirent {
     char  filename[FAT32_MAX_FILENAME + 1];
@@ -45,18 +45,27 @@ struct dirent {
     int     ref;
     uint32  off;            // offset in the parent dir entry, for writing convenience
     struct dirent *parent;  // because FAT32 doesn't have such thing like inum, use this for cache trick
+    struct dirent *mount;   // root of the volume mounted on this dir, if any
+    struct cpage *pages;    // cached pages of the file, see pcache.c
+    uint32  raseq;          // page a sequential reader reads next
+    uint32  ranext;         // first page not yet read ahead
+    uint8   wbqueued;       // write-back of the pages is queued
     struct dirent *next;
     struct dirent *prev;
     struct sleeplock    lock;
 };
 
 int             fat32_init(void);
+int             fat32_mount(int dev, struct dirent *dp);
+int             fat32_umount(struct dirent *ep);
+struct dirent*  emntpoint(struct dirent *ep);
 struct dirent*  dirlookup(struct dirent *entry, char *filename, uint *poff);
 char*           formatname(char *name);
 void            emake(struct dirent *dp, struct dirent *ep, uint off);
 struct dirent*  ealloc(struct dirent *dp, char *name, int attr);
 struct dirent*  edup(struct dirent *entry);
 void            eupdate(struct dirent *entry);
+void            esync(struct dirent *entry);
 void            etrunc(struct dirent *entry);
 void            eremove(struct dirent *entry);
 void            eput(struct dirent *entry);
@@ -68,5 +77,6 @@ struct dirent*  ename(char *path);
 struct dirent*  enameparent(char *path, char *name);
 int             eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
 int             ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n);
+int             epageio(struct dirent *entry, uint off, char *data, int write);
 
 #endif
\ No newline at end of file
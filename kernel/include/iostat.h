@@ -0,0 +1,53 @@
+#ifndef __IOSTAT_H
+#define __IOSTAT_H
+
+#include "types.h"
+
+// blkctl() commands
+#define BLK_POLL        1   // set polling spin budget in us (arg < 0 only queries)
+#define BLK_POLLSTAT    2   // copy struct pollstat out to user address arg
+#define BLK_STAT        3   // copy struct iostat out to user address arg
+#define BLK_INFO        4   // copy struct blkinfo out to user address arg
+#define BLK_WBCACHE     5   // write-back buffer cache on (arg 1) or off (0), < 0 only queries
+
+#define BLKNAMESZ       8
+
+// Latency histograms are log2-bucketed in microseconds:
+// bkt[i] counts requests that took [2^i, 2^(i+1)) us,
+// bkt[0] also takes anything under 1 us.
+#define NLATBKT         24
+
+struct lathist {
+  uint64 count;             // number of requests recorded
+  uint64 total;             // sum of their latencies (us)
+  uint64 bkt[NLATBKT];
+};
+
+struct pollstat {
+  uint64 spin;              // current spin budget (us), 0 means interrupt mode
+  uint64 hits;              // requests completed while spinning
+  uint64 misses;            // requests that slept after the spin ran out
+  struct lathist lat[2];    // [0] interrupt mode, [1] polling mode
+};
+
+struct blkinfo {
+  char name[BLKNAMESZ];     // driver name and unit, e.g. "virtio0"
+  uint64 capacity;          // in sectors, 0 if the driver can't tell
+  uint64 qdepth;            // requests the device takes at once
+};
+
+// per-device counters kept by the block layer (disk.c)
+struct iostat {
+  uint64 reads;             // read requests issued to the device
+  uint64 writes;            // write requests issued to the device
+  uint64 rsectors;          // sectors read
+  uint64 wsectors;          // sectors written
+  uint64 merges;            // requests merged before issue (no merging yet)
+  uint64 cached;            // bread()s served by the buffer cache
+  uint64 flushes;           // cache flushes sent to the device
+  uint64 in_flight;         // requests currently at the device
+  uint64 busy;              // time with at least one request in flight (us)
+  struct lathist lat[2];    // [0] reads, [1] writes
+};
+
+#endif
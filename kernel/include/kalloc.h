@@ -4,8 +4,15 @@
 #include "types.h"
 
 void*           kalloc(void);
+void*           kzalloc(void);
+int             kzfill(void);
 void            kfree(void *);
+void            krefinc(void *);
+int             krefcnt(void *);
+void*           kalloc_pages(int order);
+void            kfree_pages(void *pa, int order);
 void            kinit(void);
 uint64          freemem_amount(void);
+void            kalloc_fraginfo(uint64 *nfree);
 
 #endif
\ No newline at end of file
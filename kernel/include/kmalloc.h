@@ -0,0 +1,12 @@
+#ifndef __KMALLOC_H
+#define __KMALLOC_H
+
+#include "types.h"
+
+#define KMALLOC_MAX     1024    // largest object kmalloc() hands out
+
+void            kmallocinit(void);
+void*           kmalloc(uint size);
+void            kmfree(void *);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __MEMBENCH_H
+#define __MEMBENCH_H
+
+// membench() operations. Each runs the kernel's routine reps
+// times on n bytes at the given offsets into two 8 KB
+// buffers, or the plain byte loops it replaced with MB_BYTEWISE.
+#define MB_MEMSET       0   // memset(dst, c, n)
+#define MB_MEMMOVE      1   // memmove(dst, src, n)
+#define MB_OVERLAP      2   // memmove(dst + dstoff, dst + srcoff, n), in one buffer
+#define MB_MEMCMP       3   // memcmp(dst, src, n) of buffers equal but for the last byte
+#define MB_PAGEZERO     4   // pagezero(dst), n and the offsets are ignored
+#define MB_PAGECOPY     5   // pagecopy(dst, src), likewise
+
+#define MB_BYTEWISE     0x100
+
+#define MB_MAXOFF       64  // offsets are below this
+
+#endif
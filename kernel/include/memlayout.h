@@ -46,8 +46,11 @@
 
 #ifdef QEMU
 // virtio mmio interface
+// one page per slot, slot n interrupts on VIRTIO0_IRQ + n.
 #define VIRTIO0                 0x10001000
 #define VIRTIO0_V               (VIRTIO0 + VIRT_OFFSET)
+#define NVIRTIO                 8
+#define VIRTIO_V(n)             (VIRTIO0_V + (n) * PGSIZE)
 #endif
 
 // local interrupt controller, which contains the timer.
@@ -110,8 +113,9 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
-// #define KSTACK(p)               (TRAMPOLINE - ((p) + 1) * 2 * PGSIZE)
+// kernel stacks of the process slots, each above an invalid guard page.
 #define VKSTACK                 0x3EC0000000L
+#define KSTACK(p)               (VKSTACK + ((p) * 2 + 1) * PGSIZE)
 
 // User memory layout.
 // Address zero first:
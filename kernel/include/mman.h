@@ -0,0 +1,17 @@
+#ifndef __MMAN_H
+#define __MMAN_H
+
+// mmap() protections
+#define PROT_NONE       0
+#define PROT_READ       1
+#define PROT_WRITE      2
+#define PROT_EXEC       4
+
+// mmap() flags; exactly one of MAP_SHARED and MAP_PRIVATE
+#define MAP_SHARED      0x01    // stores reach the file, on munmap() or exit
+#define MAP_PRIVATE     0x02    // stores stay private to the process
+#define MAP_ANONYMOUS   0x20    // zero-filled, no file (MAP_PRIVATE only)
+
+#define MAP_FAILED      ((void *) -1)
+
+#endif
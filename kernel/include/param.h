@@ -4,10 +4,10 @@
 #define NPROC        50  // maximum number of processes
 #define NCPU          2  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
-#define ROOTDEV       1  // device number of file system root disk
+#define ROOTDEV       0  // device number of file system root disk
+#define NDISK         4  // maximum number of block devices
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
@@ -16,4 +16,10 @@
 #define MAXPATH      260   // maximum file path name
 #define INTERVAL     (390000000 / 200) // timer interrupt interval
 
+// RAM disk size in bytes, a multiple of the page size, 0 for none.
+// Override with make RAMDISK_SIZE=...
+#ifndef RAMDISK_SIZE
+#define RAMDISK_SIZE (256 * 1024)
+#endif
+
 #endif
\ No newline at end of file
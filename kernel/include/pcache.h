@@ -0,0 +1,32 @@
+#ifndef __PCACHE_H
+#define __PCACHE_H
+
+#include "types.h"
+
+struct dirent;
+
+// A page of a file's data, cached for its directory entry.
+// data is protected by the entry's sleeplock, the rest by the
+// page cache's lock (see pcache.c).
+struct cpage {
+  struct dirent *ep;
+  uint index;                   // file offset / PGSIZE
+  int ref;                      // holders between pcget() and pcput()
+  int dirty;
+  char *data;                   // kalloc()ed; mmap() maps it too
+  struct cpage *hnext;          // hash chain
+  struct cpage *prev;           // LRU list
+  struct cpage *next;
+  struct cpage *eprev;          // pages of ep
+  struct cpage *enext;
+};
+
+void            pcinit(void);
+struct cpage*   pcget(struct dirent *ep, uint index, int fill);
+void            pcput(struct cpage *pg, int dirty);
+void            pcflush(struct dirent *ep);
+void            pcdrop(struct dirent *ep);
+void            pcreadahead(struct dirent *ep, uint index);
+void            pcsync(void);
+
+#endif
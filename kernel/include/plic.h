@@ -81,7 +81,8 @@
 
 #ifdef QEMU     // QEMU 
 #define UART_IRQ    10 
-#define DISK_IRQ    1
+#define VIRTIO0_IRQ 1       // slot n of the virtio mmio bus is VIRTIO0_IRQ + n
+#define DISK_IRQ    VIRTIO0_IRQ
 #else           // k210 
 #define UART_IRQ    33
 #define DISK_IRQ    27
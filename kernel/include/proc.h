@@ -8,6 +8,7 @@
 #include "file.h"
 #include "fat32.h"
 #include "trap.h"
+#include "vma.h"
 
 // Saved registers for kernel context switches.
 struct context {
@@ -35,6 +36,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this hart's TLB is clean for
 };
 
 extern struct cpu cpus[NCPU];
@@ -56,20 +58,27 @@ struct proc {
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
-  pagetable_t kpagetable;      // Kernel page table
+  pagetable_t pagetable;       // User page table, with the kernel mapped
+  uint64 asid;                 // ASID and its generation, see uvmswitch()
+  int lastcpu;                 // hart it last ran on
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct dirent *cwd;          // Current directory
+  struct vma *vma;             // File-backed regions of user memory
   char name[16];               // Process name (debugging)
   int tmask;                    // trace mask
+  void (*kfn)(void);           // body of a kernel thread, 0 for user processes
+  int pin;                     // while nonzero, swapout() leaves our pages alone
+  char *spawnpath;             // what spawn() wants exec()ed, 0 once it's done
+  char **spawnargv;            // (both in the waiting parent's kernel memory)
 };
 
 void            reg_info(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char *path, char **argv);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -83,6 +92,7 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+int             kthread(char *name, void (*fn)(void));
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
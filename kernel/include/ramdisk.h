@@ -0,0 +1,6 @@
+#ifndef __RAMDISK_H
+#define __RAMDISK_H
+
+void ramdisk_init(void);
+
+#endif 
@@ -43,6 +43,8 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User Memory
+#define SSTATUS_PUM (1L << 18) // Protect User Memory, the same bit in spec 1.9.1 (k210)
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -189,6 +191,13 @@ w_mtvec(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// address space ID field of satp; 0 is the kernel page table's.
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK 0xffffL
+#define SATP_ASID(satp) (((satp) >> SATP_ASID_SHIFT) & SATP_ASID_MASK)
+#define MAKE_SATP_ASID(pagetable, asid) \
+  (MAKE_SATP(pagetable) | ((uint64)(asid) << SATP_ASID_SHIFT))
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -333,6 +342,29 @@ sfence_vma()
   asm volatile("sfence.vma");
 }
 
+// flush the TLB entries for the page at va, in every address space.
+// The k210 (privileged spec 1.9.1) has no targeted flush.
+static inline void
+sfence_vma_va(uint64 va)
+{
+  #ifdef QEMU
+  asm volatile("sfence.vma %0, zero" : : "r" (va) : "memory");
+  #else
+  asm volatile("sfence.vma");
+  #endif
+}
+
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  #ifdef QEMU
+  asm volatile("sfence.vma zero, %0" : : "r" (asid) : "memory");
+  #else
+  asm volatile("sfence.vma");
+  #endif
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -345,6 +377,10 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // copy-on-write, in the bits left to software
+#define PTE_SWAP (1L << 9) // not valid: paged out, see swap.c
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -358,6 +394,11 @@ sfence_vma()
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
 #define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
 
+// a PTE with any of R, W, X set is a leaf; at level 1 it maps
+// a 2 MB superpage.
+#define PTE_LEAF(pte) ((pte) & (PTE_R|PTE_W|PTE_X))
+#define SUPERPGSIZE (1L << PXSHIFT(1))
+
 // one beyond the highest possible virtual address.
 // MAXVA is actually one bit less than the max allowed by
 // Sv39, to avoid having to sign-extend virtual addresses
@@ -0,0 +1,32 @@
+#ifndef __SHM_H
+#define __SHM_H
+
+#include "types.h"
+
+// shmget() keys and flags
+#define IPC_PRIVATE     0       // a new segment no other key finds
+#define IPC_CREAT       0x200   // create the segment if the key has none
+#define IPC_EXCL        0x400   // with IPC_CREAT, fail if it exists
+
+#define NSHM            16      // shared-memory segments in the system
+#define SHMMAXPG        128     // pages in a segment, at most
+
+// A shared-memory segment. Its pages are mapped by every process
+// that attached it (see uvmfault()), and freed with the segment
+// when the last of them detaches.
+struct shm {
+  int used;
+  int key;
+  int ref;                      // attachments
+  uint npage;
+  char *pages[SHMMAXPG];
+};
+
+void            shminit(void);
+int             shmcreate(int key, uint64 size, int flags);
+struct shm*     shmattach(int id);
+void            shmdup(struct shm *s);
+void            shmput(struct shm *s);
+char*           shmpage(struct shm *s, uint index);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __SWAP_H
+#define __SWAP_H
+
+#include "types.h"
+#include "riscv.h"
+
+#define NSWAP           2048    // swap slots used at most, 8 MB
+
+// A PTE of a paged-out page has PTE_SWAP instead of PTE_V, its
+// other flags as they were, and the swap slot where the PPN was.
+#define SLOT2PTE(slot)  (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte)   ((uint)((pte) >> 10))
+
+struct sysinfo;
+
+void            swapinit(void);
+int             swapon(char *path);
+int             swapout(void);
+int             swapin(uint slot, char *mem);
+void            swapdup(uint slot);
+void            swapfree(uint slot);
+void            swapinfo(struct sysinfo *info);
+
+#endif
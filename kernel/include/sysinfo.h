@@ -3,9 +3,18 @@
 
 #include "types.h"
 
+// The page allocator hands out blocks of 2^order pages,
+// order 0 to NORDER-1.
+#define NORDER      11
+
 struct sysinfo {
   uint64 freemem;   // amount of free memory (bytes)
   uint64 nproc;     // number of process
+  uint64 nfree[NORDER]; // free blocks of 2^i pages
+  uint64 swapsize;  // bytes of swap file in use as swap space
+  uint64 swapused;  // bytes of it holding paged-out pages
+  uint64 swapins;   // pages read back in from it
+  uint64 swapouts;  // pages written out to it
 };
 
 
@@ -28,6 +28,19 @@
 #define SYS_readdir     24
 #define SYS_getcwd      25
 #define SYS_rename      26
+#define SYS_blkctl      27
+#define SYS_mount       28
+#define SYS_umount      29
+#define SYS_fsync       30
+#define SYS_sync        31
+#define SYS_mmap        32
+#define SYS_munmap      33
+#define SYS_shmget      34
+#define SYS_shmat       35
+#define SYS_shmdt       36
+#define SYS_spawn       37
+#define SYS_swapon      38
+#define SYS_membench    39
 
 #define SYS_getppid     173
 
@@ -4,6 +4,16 @@
 #include "types.h"
 #include "spinlock.h"
 
+// frequency of the time CSR read by r_time()
+#ifdef QEMU
+#define TIMEBASE        10000000
+#else
+#define TIMEBASE        7800000     // k210: cpu clock / 50
+#endif
+
+#define TIME2US(t)      ((t) * 1000000 / TIMEBASE)
+#define US2TIME(us)     ((us) * TIMEBASE / 1000000)
+
 extern struct spinlock tickslock;
 extern uint ticks;
 
@@ -33,6 +33,7 @@
 #define VIRTIO_MMIO_INTERRUPT_STATUS	0x060 // read-only
 #define VIRTIO_MMIO_INTERRUPT_ACK	0x064 // write-only
 #define VIRTIO_MMIO_STATUS		0x070 // read/write
+#define VIRTIO_MMIO_CONFIG		0x100 // device-specific config space
 
 // status register bits, from qemu virtio_config.h
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
@@ -42,6 +43,7 @@
 
 // device feature bits
 #define VIRTIO_BLK_F_RO              5	/* Disk is read-only */
+#define VIRTIO_BLK_F_FLUSH           9	/* Cache flush command support */
 #define VIRTIO_BLK_F_SCSI            7	/* Supports scsi command passthru */
 #define VIRTIO_BLK_F_CONFIG_WCE     11	/* Writeback mode available in config */
 #define VIRTIO_BLK_F_MQ             12	/* support more than one vq */
@@ -62,6 +64,8 @@ struct VRingDesc {
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
 
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // don't interrupt when consuming a buffer
+
 struct VRingUsedElem {
   uint32 id;   // index of start of completed descriptor chain
   uint32 len;
@@ -70,6 +74,7 @@ struct VRingUsedElem {
 // for disk ops
 #define VIRTIO_BLK_T_IN  0 // read the disk
 #define VIRTIO_BLK_T_OUT 1 // write the disk
+#define VIRTIO_BLK_T_FLUSH 4 // write back the device's cache
 
 struct UsedArea {
   uint16 flags;
@@ -78,7 +83,5 @@ struct UsedArea {
 };
 
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *b, int write);
-void            virtio_disk_intr(void);
 
 #endif
@@ -4,30 +4,36 @@
 #include "types.h"
 #include "riscv.h"
 
+struct proc;
+
 void            kvminit(void);
 void            kvminithart(void);
+void            kvmswitch(void);
+void            asidinit(void);
+void            uvmswitch(struct proc *p);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 // void            uvminit(pagetable_t, uchar *, uint);
-void            uvminit(pagetable_t, pagetable_t, uchar *, uint);
-uint64          uvmalloc(pagetable_t, pagetable_t, uint64, uint64);
-uint64          uvmdealloc(pagetable_t, pagetable_t, uint64, uint64);
-// int             uvmcopy(pagetable_t, pagetable_t, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, pagetable_t, uint64);
+void            uvminit(pagetable_t, uchar *, uint);
+uint64          uvmalloc(pagetable_t, uint64, uint64);
+uint64          uvmdealloc(pagetable_t, uint64, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, uint64, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmfault(struct proc *p, uint64 va, int write);
+int             uvmmunmap(struct proc *p, uint64 va, uint64 len);
+int             uvmpin(uint64 va, uint64 len, int write);
+void            uvmunpin(void);
 void            uvmfree(pagetable_t, uint64);
 // void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            vmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+pte_t*          uvmnext(pagetable_t pagetable, uint64 *va);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
-pagetable_t     proc_kpagetable(void);
-void            kvmfreeusr(pagetable_t kpt);
-void            kvmfree(pagetable_t kpagetable, int stack_free);
-uint64          kwalkaddr(pagetable_t pagetable, uint64 va);
 int             copyout2(uint64 dstva, char *src, uint64 len);
 int             copyin2(char *dst, uint64 srcva, uint64 len);
 int             copyinstr2(char *dst, uint64 srcva, uint64 max);
@@ -0,0 +1,39 @@
+#ifndef __VMA_H
+#define __VMA_H
+
+#include "types.h"
+
+struct dirent;
+struct shm;
+
+// A region of a user address space whose pages are filled from a
+// file when first touched (see uvmfault()). Bytes past filesz read
+// as zero.
+// exec() segments have flags 0 and live below p->sz; mmap() regions
+// and shmat()ed segments carry MAP_* flags and live above it,
+// growing down from MAXUVA.
+struct vma {
+  uint64 start;             // page-aligned
+  uint64 end;
+  struct dirent *ep;        // backing file, holds a reference; 0 if anonymous
+  uint64 off;               // file offset of start
+  uint64 filesz;            // bytes of the region backed by the file
+  int prot;                 // PROT_* (mmap() regions only)
+  int flags;                // MAP_*, 0 for exec() segments
+  struct shm *shm;          // attached shared-memory segment, off indexes it
+  struct vma *next;
+};
+
+int             vmaadd(struct vma **list, uint64 start, uint64 end, struct dirent *ep, uint64 off, uint64 filesz,
+                       int prot, int flags);
+struct vma*     vmafind(struct vma *list, uint64 va);
+int             vmadup(struct vma **dst, struct vma *src);
+void            vmatrim(struct vma **list, uint64 sz);
+void            vmafree(struct vma **list);
+char*           vmapage(struct vma *v, uint64 va);
+int             vmafill(struct vma *v, uint64 va, char *mem);
+int             vmawrite(struct vma *v, uint64 va, char *mem);
+int             vmaremove(struct vma **list, uint64 start, uint64 end);
+uint64          vmalowest(struct vma *list);
+
+#endif
@@ -1,6 +1,25 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Free memory is kept by a buddy allocator in blocks of 2^order
+// pages, order 0 to NORDER-1; kalloc_pages() hands out physically
+// contiguous blocks and kfree_pages() coalesces them with their
+// buddies again.
+//
+// Single pages go through a front end: each hart keeps a small free
+// list of its own, so that most kalloc()/kfree() calls touch no
+// shared lock. Pages move between a hart's list and the buddy
+// allocator KBATCH at a time; a hart whose list and the buddy
+// allocator are both empty steals from the other harts.
+//
+// Every page handed out by kalloc() carries a reference count,
+// so that address spaces can share pages copy-on-write; kfree()
+// only frees a page once its last reference is dropped.
+//
+// kzalloc() hands out pages from a small pool that idle harts keep
+// zeroed (see kzfill()), so callers that need a clean page don't
+// pay for clearing it.
 
 
 #include "include/types.h"
@@ -8,68 +27,320 @@
 #include "include/memlayout.h"
 #include "include/riscv.h"
 #include "include/spinlock.h"
+#include "include/intr.h"
+#include "include/proc.h"
 #include "include/kalloc.h"
+#include "include/sysinfo.h"
+#include "include/timer.h"
 #include "include/string.h"
 #include "include/printf.h"
 
+#define KBATCH    16            // pages moved to or from the buddy allocator at once
+#define KHIGH     (4 * KBATCH)  // a hart holding more gives KBATCH back
+#define KZPOOL    16            // pre-zeroed pages kept for kzalloc()
+
+// Pages are numbered from the start of RAM rather than KERNBASE,
+// which is not aligned to the largest block, so that a block's
+// buddy is found by flipping a bit of its number and every block
+// is aligned to its size. The pages below kernel_end stay PG_USED.
+#define RAMBASE   0x80000000L
+#define NPAGE     ((PHYSTOP - RAMBASE) >> PGSHIFT)
+#define PG_USED   0xff          // kmem.order[] of a page that heads no free block
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char kernel_end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;             // buddy free lists only
 };
 
+// buddy allocator
+struct {
+  struct spinlock lock;
+  struct run area[NORDER];      // circular free lists, one per order
+  uint64 nfree[NORDER];         // blocks on each list
+  uint64 npage;                 // pages in all of them
+  uchar order[NPAGE];           // order of the free block a page heads, or PG_USED
+} kmem;
+
+// references to each page allocated by kalloc(), updated atomically
+static int pgref[NPAGE];
+
+// per-hart free lists. The lock is only contended by stealing.
 struct {
   struct spinlock lock;
   struct run *freelist;
   uint64 npage;
-} kmem;
+} kcpu[NCPU];
+
+// pages already cleared to zero, handed out by kzalloc()
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  uint64 npage;
+} kzero;
 
 void
 kinit()
 {
+  uint64 start = r_time();
+
   initlock(&kmem.lock, "kmem");
-  kmem.freelist = 0;
+  for(int i = 0; i < NORDER; i++){
+    kmem.area[i].next = kmem.area[i].prev = &kmem.area[i];
+    kmem.nfree[i] = 0;
+  }
   kmem.npage = 0;
+  memset(kmem.order, PG_USED, sizeof(kmem.order));
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcpu[i].lock, "kcpu");
+  initlock(&kzero.lock, "kzero");
   freerange(kernel_end, (void*)PHYSTOP);
+  printf("kinit: %d KB free in %d us\n", (int)(kmem.npage << PGSHIFT >> 10),
+         (int)TIME2US(r_time() - start));
   #ifdef DEBUG
   printf("kernel_end: %p, phystop: %p\n", kernel_end, (void*)PHYSTOP);
   printf("kinit\n");
   #endif
 }
 
+static int
+mycpuid(void)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id;
+}
+
+static inline uint64
+pagenum(void *pa)
+{
+  return ((uint64)pa - RAMBASE) >> PGSHIFT;
+}
+
+static inline struct run *
+pageaddr(uint64 pn)
+{
+  return (struct run*)(RAMBASE + (pn << PGSHIFT));
+}
+
+// Put the free block of 2^order pages at pn on its free list.
+// Caller holds kmem.lock.
+static void
+area_add(uint64 pn, int order)
+{
+  struct run *r = pageaddr(pn);
+
+  r->next = kmem.area[order].next;
+  r->prev = &kmem.area[order];
+  r->next->prev = r;
+  kmem.area[order].next = r;
+  kmem.order[pn] = order;
+  kmem.nfree[order]++;
+}
+
+// Take the free block at pn off its free list.
+// Caller holds kmem.lock.
+static void
+area_del(uint64 pn)
+{
+  struct run *r = pageaddr(pn);
+
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.nfree[kmem.order[pn]]--;
+  kmem.order[pn] = PG_USED;
+}
+
+// Return the 2^order pages at pa to the buddy allocator, merging
+// with the buddy block for as long as it is free as a whole.
+// Caller holds kmem.lock.
+static void
+buddy_free(void *pa, int order)
+{
+  uint64 pn = pagenum(pa);
+  uint64 buddy;
+
+  kmem.npage += 1UL << order;
+  for(; order < NORDER - 1; order++){
+    buddy = pn ^ (1UL << order);
+    if(buddy >= NPAGE || kmem.order[buddy] != order)
+      break;
+    area_del(buddy);
+    pn &= ~(1UL << order);
+  }
+  area_add(pn, order);
+}
+
+// Allocate 2^order contiguous pages, splitting a larger block
+// if there is no free one of the right size.
+// Caller holds kmem.lock.
+static void *
+buddy_alloc(int order)
+{
+  uint64 pn;
+  int o;
+
+  for(o = order; o < NORDER; o++){
+    if(kmem.area[o].next != &kmem.area[o])
+      break;
+  }
+  if(o == NORDER)
+    return 0;
+
+  pn = pagenum(kmem.area[o].next);
+  area_del(pn);
+  while(o > order){
+    o--;
+    area_add(pn + (1UL << o), o);   // upper half stays free
+  }
+  kmem.npage -= 1UL << order;
+  return (void*)pageaddr(pn);
+}
+
+// Hand [pa_start, pa_end) to the buddy allocator as the largest
+// aligned blocks that fit. Only the first page of each block is
+// written; the blocks get split as allocations need them.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  uint64 p = PGROUNDUP((uint64)pa_start);
+  int order;
+
+  acquire(&kmem.lock);
+  while(p + PGSIZE <= (uint64)pa_end){
+    order = 0;
+    while(order < NORDER - 1 && (pagenum((void*)p) & (1UL << order)) == 0 &&
+          p + (PGSIZE << (order + 1)) <= (uint64)pa_end)
+      order++;
+    buddy_free((void*)p, order);
+    p += PGSIZE << order;
+  }
+  release(&kmem.lock);
+}
+
+// Detach up to n pages from the list at *head, which holds *npage.
+// Returns the chain and stores its length in *got.
+// Caller holds the list's lock.
+static struct run *
+takepages(struct run **head, uint64 *npage, int n, int *got)
+{
+  struct run *first = *head, *r = 0;
+  int i;
+
+  for(i = 0; i < n && *head; i++){
+    r = *head;
+    *head = r->next;
+  }
+  if(r)
+    r->next = 0;
+  *npage -= i;
+  *got = i;
+  return i ? first : 0;
+}
+
+// Splice the chain of n pages onto the list at *head.
+// Caller holds the list's lock.
+static void
+putpages(struct run **head, uint64 *npage, struct run *chain, int n)
+{
+  struct run *r;
+
+  if(chain == 0)
+    return;
+  for(r = chain; r->next; r = r->next)
+    ;
+  r->next = *head;
+  *head = chain;
+  *npage += n;
+}
+
+// Give a chain of single pages back to the buddy allocator.
+static void
+drainpages(struct run *chain)
+{
+  struct run *next;
+
+  acquire(&kmem.lock);
+  for(; chain; chain = next){
+    next = chain->next;
+    buddy_free(chain, 0);
+  }
+  release(&kmem.lock);
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc().
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *chain = 0;
+  int id, n = 0;
   
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < kernel_end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = __sync_sub_and_fetch(&pgref[pagenum(pa)], 1)) != 0){
+    if(n < 0)
+      panic("kfree: ref");
+    return;
+  }
+
+  #ifdef DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+  #endif
 
   r = (struct run*)pa;
 
+  id = mycpuid();
+  acquire(&kcpu[id].lock);
+  r->next = kcpu[id].freelist;
+  kcpu[id].freelist = r;
+  if(++kcpu[id].npage > KHIGH)
+    chain = takepages(&kcpu[id].freelist, &kcpu[id].npage, KBATCH, &n);
+  release(&kcpu[id].lock);
+
+  if(chain)
+    drainpages(chain);
+}
+
+// Get a batch of pages for hart id: from the buddy allocator if
+// it has any, else half of the fullest other hart's list.
+static struct run *
+refill(int id, int *got)
+{
+  struct run *chain = 0, *r;
+  int victim = -1;
+
+  *got = 0;
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  kmem.npage++;
+  while(*got < KBATCH && (r = buddy_alloc(0)) != 0){
+    r->next = chain;
+    chain = r;
+    (*got)++;
+  }
   release(&kmem.lock);
+  if(chain)
+    return chain;
+
+  for(int i = 0; i < NCPU; i++){
+    if(i != id && kcpu[i].npage > 0 && (victim < 0 || kcpu[i].npage > kcpu[victim].npage))
+      victim = i;
+  }
+  if(victim < 0)
+    return 0;
+  acquire(&kcpu[victim].lock);
+  chain = takepages(&kcpu[victim].freelist, &kcpu[victim].npage,
+                    (kcpu[victim].npage + 1) / 2, got);
+  release(&kcpu[victim].lock);
+  return chain;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -78,23 +349,205 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct run *r, *chain;
+  int id, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  id = mycpuid();
+  acquire(&kcpu[id].lock);
+  r = kcpu[id].freelist;
   if(r) {
-    kmem.freelist = r->next;
-    kmem.npage--;
+    kcpu[id].freelist = r->next;
+    kcpu[id].npage--;
+  }
+  release(&kcpu[id].lock);
+
+  if(r == 0 && (chain = refill(id, &n)) != 0){
+    r = chain;
+    acquire(&kcpu[id].lock);
+    putpages(&kcpu[id].freelist, &kcpu[id].npage, chain->next, n - 1);
+    release(&kcpu[id].lock);
   }
+
+  // Out of memory: the zeroed pool is free memory too.
+  if(r == 0){
+    acquire(&kzero.lock);
+    if((r = kzero.freelist) != 0){
+      kzero.freelist = r->next;
+      kzero.npage--;
+    }
+    release(&kzero.lock);
+  }
+
+  if(r == 0)
+    return 0;
+  pgref[pagenum(r)] = 1;
+  #ifdef DEBUG
+  memset((char*)r, 5, PGSIZE); // fill with junk
+  #endif
+  return (void*)r;
+}
+
+// Add a reference to a page allocated by kalloc().
+void
+krefinc(void *pa)
+{
+  __sync_fetch_and_add(&pgref[pagenum(pa)], 1);
+}
+
+// The number of references to a page allocated by kalloc().
+int
+krefcnt(void *pa)
+{
+  return pgref[pagenum(pa)];
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size. Returns 0 if there is no free block that large.
+void *
+kalloc_pages(int order)
+{
+  struct run *chain;
+  void *pa;
+  int n;
+
+  if(order < 0 || order >= NORDER)
+    return 0;
+  if(order == 0)
+    return kalloc();
+
+  acquire(&kmem.lock);
+  pa = buddy_alloc(order);
   release(&kmem.lock);
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  // Pages parked on the per-hart lists keep their buddies from
+  // merging; hand them all back and try once more.
+  if(pa == 0){
+    for(int i = 0; i < NCPU; i++){
+      acquire(&kcpu[i].lock);
+      chain = takepages(&kcpu[i].freelist, &kcpu[i].npage, kcpu[i].npage, &n);
+      release(&kcpu[i].lock);
+      drainpages(chain);
+    }
+    acquire(&kmem.lock);
+    pa = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+
+  #ifdef DEBUG
+  if(pa)
+    memset(pa, 5, PGSIZE << order);
+  #endif
+  return pa;
+}
+
+// Free 2^order pages allocated by kalloc_pages(order).
+void
+kfree_pages(void *pa, int order)
+{
+  if(order < 0 || order >= NORDER)
+    panic("kfree_pages: order");
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if((pagenum(pa) & ((1UL << order) - 1)) != 0 || (char*)pa < kernel_end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_pages");
+
+  #ifdef DEBUG
+  memset(pa, 1, PGSIZE << order);
+  #endif
+
+  acquire(&kmem.lock);
+  buddy_free(pa, order);
+  release(&kmem.lock);
+}
+
+// Allocate one page of physical memory filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+void *
+kzalloc(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  if((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    kzero.npage--;
+  }
+  release(&kzero.lock);
+
+  if(r){
+    r->next = 0;      // the only word the free list dirtied
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    pagezero(r);
   return (void*)r;
 }
 
+// Zero one page into the kzalloc() pool if it is below KZPOOL.
+// Called by idle harts from scheduler(); returns 0 when there
+// was nothing to do, so the caller may go to sleep.
+int
+kzfill(void)
+{
+  struct run *r;
+
+  if(kzero.npage >= KZPOOL)
+    return 0;
+  if((r = kalloc()) == 0)
+    return 0;
+  pagezero(r);
+
+  acquire(&kzero.lock);
+  if(kzero.npage >= KZPOOL){
+    release(&kzero.lock);
+    kfree(r);
+    return 0;
+  }
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.npage++;
+  release(&kzero.lock);
+  return 1;
+}
+
 uint64
 freemem_amount(void)
 {
-  return kmem.npage << PGSHIFT;
+  uint64 n;
+
+  acquire(&kmem.lock);
+  n = kmem.npage;
+  release(&kmem.lock);
+  acquire(&kzero.lock);
+  n += kzero.npage;
+  release(&kzero.lock);
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kcpu[i].lock);
+    n += kcpu[i].npage;
+    release(&kcpu[i].lock);
+  }
+  return n << PGSHIFT;
+}
+
+// Copy the number of free buddy blocks of each order into nfree[].
+// Pages on the per-hart lists and in the zeroed pool are counted
+// as single pages, since that is all they can be handed out as.
+void
+kalloc_fraginfo(uint64 *nfree)
+{
+  acquire(&kmem.lock);
+  for(int i = 0; i < NORDER; i++)
+    nfree[i] = kmem.nfree[i];
+  release(&kmem.lock);
+  acquire(&kzero.lock);
+  nfree[0] += kzero.npage;
+  release(&kzero.lock);
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kcpu[i].lock);
+    nfree[0] += kcpu[i].npage;
+    release(&kcpu[i].lock);
+  }
 }
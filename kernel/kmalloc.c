@@ -0,0 +1,217 @@
+// Allocator for small kernel objects, up to KMALLOC_MAX bytes.
+//
+// Each power-of-two size class is a cache of slabs. A slab is one
+// page from kalloc(): a struct slab header at the start and as many
+// objects as fit behind it, the free ones linked through their
+// first word. kmfree() finds an object's slab by rounding its
+// address down to the page.
+//
+// In front of every cache, each hart keeps a magazine of up to
+// NMAG free objects, used with interrupts off instead of a lock.
+// Magazines refill from and spill to the slabs NMAG/2 at a time.
+
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/intr.h"
+#include "include/proc.h"
+#include "include/kalloc.h"
+#include "include/kmalloc.h"
+#include "include/printf.h"
+
+#define MINSHIFT  5             // smallest class is 32 bytes
+#define NCLASS    6             // 32 .. KMALLOC_MAX bytes
+#define NMAG      16            // objects a hart keeps per class
+
+struct object {
+  struct object *next;
+};
+
+struct slab {
+  struct slab *next;            // on its cache's partial list
+  struct slab *prev;
+  struct kmcache *cache;
+  struct object *free;          // free objects in this slab
+  uint inuse;
+  uint total;
+};
+
+struct kmcache {
+  struct spinlock lock;
+  uint size;
+  struct slab partial;          // slabs with free objects
+  uint nempty;                  // of those, slabs with none in use
+  struct {
+    uint n;
+    struct object *obj[NMAG];
+  } mag[NCPU];
+};
+
+static struct kmcache caches[NCLASS];
+
+void
+kmallocinit(void)
+{
+  for(int i = 0; i < NCLASS; i++){
+    struct kmcache *c = &caches[i];
+    initlock(&c->lock, "kmcache");
+    c->size = 1 << (MINSHIFT + i);
+    c->partial.next = c->partial.prev = &c->partial;
+    c->nempty = 0;
+    for(int j = 0; j < NCPU; j++)
+      c->mag[j].n = 0;
+  }
+  #ifdef DEBUG
+  printf("kmallocinit\n");
+  #endif
+}
+
+static struct kmcache *
+sizecache(uint size)
+{
+  int i = 0;
+
+  while((1U << (MINSHIFT + i)) < size)
+    i++;
+  return &caches[i];
+}
+
+static void
+slab_link(struct kmcache *c, struct slab *s)
+{
+  s->next = c->partial.next;
+  s->prev = &c->partial;
+  s->next->prev = s;
+  c->partial.next = s;
+}
+
+static void
+slab_unlink(struct slab *s)
+{
+  s->prev->next = s->next;
+  s->next->prev = s->prev;
+}
+
+// Carve a fresh page into a slab of c's objects.
+// Caller holds c->lock.
+static struct slab *
+slab_new(struct kmcache *c)
+{
+  struct slab *s;
+  char *p;
+
+  if((s = kalloc()) == NULL)
+    return NULL;
+  s->cache = c;
+  s->inuse = 0;
+  s->total = (PGSIZE - sizeof(struct slab)) / c->size;
+  s->free = 0;
+  // objects sit at the end of the page, so they stay size-aligned
+  for(p = (char*)s + PGSIZE - c->size; p >= (char*)s + PGSIZE - s->total * c->size; p -= c->size){
+    ((struct object*)p)->next = s->free;
+    s->free = (struct object*)p;
+  }
+  slab_link(c, s);
+  c->nempty++;
+  return s;
+}
+
+// Take up to n objects from c's slabs into out[].
+// Caller holds c->lock.
+static int
+slab_get(struct kmcache *c, struct object **out, int n)
+{
+  struct slab *s;
+  int got = 0;
+
+  while(got < n){
+    s = c->partial.next;
+    if(s == &c->partial && (s = slab_new(c)) == NULL)
+      break;
+    if(s->inuse == 0)
+      c->nempty--;
+    while(got < n && s->free){
+      out[got++] = s->free;
+      s->free = s->free->next;
+      s->inuse++;
+    }
+    if(s->free == 0)
+      slab_unlink(s);
+  }
+  return got;
+}
+
+// Return an object to its slab. Keeps one empty slab per cache
+// around and gives the others back to kalloc().
+// Caller holds c->lock.
+static void
+slab_put(struct kmcache *c, struct object *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+
+  if(s->cache != c)
+    panic("kmfree: bad object");
+  if(s->free == 0)
+    slab_link(c, s);
+  o->next = s->free;
+  s->free = o;
+  if(--s->inuse == 0){
+    if(c->nempty > 0){
+      slab_unlink(s);
+      kfree(s);
+    } else {
+      c->nempty++;
+    }
+  }
+}
+
+// Allocate size bytes, or 0 if size exceeds KMALLOC_MAX
+// or memory is exhausted. The memory is not cleared.
+void *
+kmalloc(uint size)
+{
+  struct kmcache *c;
+  void *p = NULL;
+  int id;
+
+  if(size == 0 || size > KMALLOC_MAX)
+    return NULL;
+  c = sizecache(size);
+
+  push_off();
+  id = cpuid();
+  if(c->mag[id].n == 0){
+    acquire(&c->lock);
+    c->mag[id].n = slab_get(c, c->mag[id].obj, NMAG / 2);
+    release(&c->lock);
+  }
+  if(c->mag[id].n > 0)
+    p = c->mag[id].obj[--c->mag[id].n];
+  pop_off();
+  return p;
+}
+
+// Free memory returned by kmalloc().
+void
+kmfree(void *p)
+{
+  struct kmcache *c;
+  int id;
+
+  if(((uint64)p % PGSIZE) == 0)
+    panic("kmfree");
+  c = ((struct slab*)PGROUNDDOWN((uint64)p))->cache;
+
+  push_off();
+  id = cpuid();
+  if(c->mag[id].n == NMAG){
+    acquire(&c->lock);
+    while(c->mag[id].n > NMAG / 2)
+      slab_put(c, c->mag[id].obj[--c->mag[id].n]);
+    release(&c->lock);
+  }
+  c->mag[id].obj[c->mag[id].n++] = p;
+  pop_off();
+}
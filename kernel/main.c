@@ -9,6 +9,9 @@
 #include "include/console.h"
 #include "include/printf.h"
 #include "include/kalloc.h"
+#include "include/kmalloc.h"
+#include "include/shm.h"
+#include "include/swap.h"
 #include "include/timer.h"
 #include "include/trap.h"
 #include "include/proc.h"
@@ -45,13 +48,17 @@ main(unsigned long hartid, unsigned long dtb_pa)
     printf("hart %d enter main()...\n", hartid);
     #endif
     kinit();         // physical page allocator
+    kmallocinit();   // small object allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address space IDs
     timerinit();     // init a lock for timer
     trapinithart();  // install kernel trap vector, including interrupt handler
     printf("trapinithart done\n");
     procinit();
     printf("procinit done\n");
+    shminit();
+    swapinit();
     plicinit();
     printf("plicinit done\n");
     plicinithart();
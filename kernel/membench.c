@@ -0,0 +1,191 @@
+// membench(): time the kernel's memory routines against the byte
+// loops they replaced, and check that they agree on the result.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/syscall.h"
+#include "include/kalloc.h"
+#include "include/timer.h"
+#include "include/string.h"
+#include "include/membench.h"
+
+#define TIME2NS(t)      ((t) * 1000 * 1000000 / TIMEBASE)
+
+static void
+bytememset(void *dst, int c, uint n)
+{
+  char *cdst = (char *) dst;
+  for(uint i = 0; i < n; i++)
+    cdst[i] = c;
+}
+
+static void
+bytememmove(void *dst, const void *src, uint n)
+{
+  const char *s = src;
+  char *d = dst;
+
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    while(n-- > 0)
+      *--d = *--s;
+  } else
+    while(n-- > 0)
+      *d++ = *s++;
+}
+
+static int
+bytememcmp(const void *v1, const void *v2, uint n)
+{
+  const uchar *s1 = v1, *s2 = v2;
+
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+// Fill the buffers with a pattern that no two bytes a word
+// apart share, for a misplaced copy to show.
+static void
+pattern(char *dst, char *src, uint n)
+{
+  for(uint i = 0; i < n; i++){
+    src[i] = i * 7 + 1;
+    dst[i] = i * 13 + 5;
+  }
+}
+
+// Run op with the byte loops on copies of the buffers as they
+// were before, and compare. Only an overlapping move changes
+// what it moves, and so needs to be run reps times over.
+// Returns 0 if all agree.
+static int
+check(int op, char *dst, char *src, char *want, char *wsrc,
+      uint dstoff, uint srcoff, uint n, int reps, int r)
+{
+  int w;
+
+  switch(op){
+  case MB_MEMSET:
+    bytememset(want + dstoff, 0xa5, n);
+    break;
+  case MB_MEMMOVE:
+    bytememmove(want + dstoff, wsrc + srcoff, n);
+    break;
+  case MB_OVERLAP:
+    while(reps-- > 0)
+      bytememmove(want + dstoff, want + srcoff, n);
+    break;
+  case MB_MEMCMP:
+    // the sign is all memcmp() promises
+    w = bytememcmp(want + dstoff, wsrc + srcoff, n);
+    if((w < 0) != (r < 0) || (w > 0) != (r > 0))
+      return -1;
+    break;
+  case MB_PAGEZERO:
+    bytememset(want, 0, PGSIZE);
+    break;
+  case MB_PAGECOPY:
+    bytememmove(want, wsrc, PGSIZE);
+    break;
+  }
+  return bytememcmp(dst, want, 2 * PGSIZE) == 0 &&
+         bytememcmp(src, wsrc, 2 * PGSIZE) == 0 ? 0 : -1;
+}
+
+// membench(op, n, dstoff, srcoff, reps): returns the time the
+// reps took in ns, or -1 if the arguments are bad, there is no
+// memory, or the result differs from the byte loops'.
+uint64
+sys_membench(void)
+{
+  int op, n, dstoff, srcoff, reps, bytewise, r = 0;
+  char *dst, *src, *want = 0, *wsrc = 0;
+  uint64 start, t;
+  uint64 ret = -1;
+
+  if(argint(0, &op) < 0 || argint(1, &n) < 0 || argint(2, &dstoff) < 0 ||
+     argint(3, &srcoff) < 0 || argint(4, &reps) < 0)
+    return -1;
+  bytewise = op & MB_BYTEWISE;
+  op &= ~MB_BYTEWISE;
+  if(op < 0 || op > MB_PAGECOPY || n < 0 || n > PGSIZE || reps <= 0 ||
+     dstoff < 0 || dstoff >= MB_MAXOFF || srcoff < 0 || srcoff >= MB_MAXOFF)
+    return -1;
+  if((dst = kalloc_pages(1)) == NULL)
+    return -1;
+  if((src = kalloc_pages(1)) == NULL)
+    goto out;
+  if((want = kalloc_pages(1)) == NULL || (wsrc = kalloc_pages(1)) == NULL)
+    goto out;
+
+  pattern(dst, src, 2 * PGSIZE);
+  if(op == MB_MEMCMP){
+    bytememmove(dst + dstoff, src + srcoff, n);
+    if(n > 0)
+      dst[dstoff + n - 1]++;
+  }
+  bytememmove(want, dst, 2 * PGSIZE);
+  bytememmove(wsrc, src, 2 * PGSIZE);
+
+  start = r_time();
+  for(int i = 0; i < reps; i++){
+    switch(op){
+    case MB_MEMSET:
+      if(bytewise)
+        bytememset(dst + dstoff, 0xa5, n);
+      else
+        memset(dst + dstoff, 0xa5, n);
+      break;
+    case MB_MEMMOVE:
+      if(bytewise)
+        bytememmove(dst + dstoff, src + srcoff, n);
+      else
+        memmove(dst + dstoff, src + srcoff, n);
+      break;
+    case MB_OVERLAP:
+      if(bytewise)
+        bytememmove(dst + dstoff, dst + srcoff, n);
+      else
+        memmove(dst + dstoff, dst + srcoff, n);
+      break;
+    case MB_MEMCMP:
+      if(bytewise)
+        r = bytememcmp(dst + dstoff, src + srcoff, n);
+      else
+        r = memcmp(dst + dstoff, src + srcoff, n);
+      break;
+    case MB_PAGEZERO:
+      if(bytewise)
+        bytememset(dst, 0, PGSIZE);
+      else
+        pagezero(dst);
+      break;
+    case MB_PAGECOPY:
+      if(bytewise)
+        bytememmove(dst, src, PGSIZE);
+      else
+        pagecopy(dst, src);
+      break;
+    }
+  }
+  t = r_time() - start;
+
+  if(check(op, dst, src, want, wsrc, dstoff, srcoff, n, reps, r) == 0)
+    ret = TIME2NS(t);
+
+ out:
+  if(wsrc)
+    kfree_pages(wsrc, 1);
+  if(want)
+    kfree_pages(want, 1);
+  if(src)
+    kfree_pages(src, 1);
+  kfree_pages(dst, 1);
+  return ret;
+}
@@ -0,0 +1,380 @@
+// Page cache for file data.
+//
+// Each directory entry keeps the 4 KB pages of its file that have
+// been read or written, indexed by file offset, so that eread()
+// and ewrite() copy to and from memory instead of walking the
+// cluster chain through the 512-byte buffer cache every time.
+//
+// A page's data is protected by its entry's sleeplock; pcache.lock
+// protects the hash, the lists, and each page's ref and dirty.
+//
+// Dirty pages are written back by the pcflushd kernel thread a few
+// ticks after they are first dirtied, or sooner by fsync(), sync()
+// and the last eput() of the entry. pcflushd also reads ahead of
+// sequential readers. mmap() maps cached pages into user memory
+// directly; a page stays cached while it is mapped.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/proc.h"
+#include "include/fat32.h"
+#include "include/kalloc.h"
+#include "include/kmalloc.h"
+#include "include/pcache.h"
+#include "include/timer.h"
+#include "include/printf.h"
+#include "include/string.h"
+
+#define NPCHASH     64
+#define PCMAX       128         // pages cached before clean ones get recycled
+#define PCRA        4           // pages read ahead of a sequential reader
+#define PCDELAY     5           // ticks a dirty page waits for write-back
+#define NPCREQ      16          // requests queued for pcflushd
+#define PCWB        0xffffffff  // request index meaning write-back
+
+// A request for pcflushd: write back ep's dirty pages, or read
+// PCRA pages of it from index.
+struct pcreq {
+  struct dirent *ep;            // holds a reference; 0 if the slot is free
+  uint index;                   // first page to read ahead, or PCWB
+  uint when;                    // ticks when it's due
+};
+
+static struct {
+  struct spinlock lock;
+  struct cpage *hash[NPCHASH];
+
+  // LRU list of all pages, through prev/next.
+  // head.next is most recent, head.prev is least.
+  struct cpage head;
+  int npage;
+  int ndirty;
+
+  struct pcreq req[NPCREQ];
+  int nreq;                     // requests queued or in progress
+} pcache;
+
+static void pcflushd(void);
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  if(kthread("pcflushd", pcflushd) < 0)
+    panic("pcinit: pcflushd");
+}
+
+static struct cpage**
+pchash(struct dirent *ep, uint index)
+{
+  return &pcache.hash[(((uint64)ep >> 4) + index) % NPCHASH];
+}
+
+// Enter pg, with ep and index set, in the hash, the front of
+// the LRU list and its entry's list. Caller holds pcache.lock.
+static void
+pclink(struct cpage *pg)
+{
+  struct cpage **hp = pchash(pg->ep, pg->index);
+
+  pg->hnext = *hp;
+  *hp = pg;
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+  pg->eprev = NULL;
+  pg->enext = pg->ep->pages;
+  if(pg->ep->pages)
+    pg->ep->pages->eprev = pg;
+  pg->ep->pages = pg;
+}
+
+// Take pg out of all lists. Caller holds pcache.lock.
+static void
+pcunlink(struct cpage *pg)
+{
+  struct cpage **hp;
+
+  for(hp = pchash(pg->ep, pg->index); *hp != pg; hp = &(*hp)->hnext)
+    ;
+  *hp = pg->hnext;
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  if(pg->eprev)
+    pg->eprev->enext = pg->enext;
+  else
+    pg->ep->pages = pg->enext;
+  if(pg->enext)
+    pg->enext->eprev = pg->eprev;
+}
+
+// A page to cache something new in: the least recently used
+// one that is idle, clean and unmapped once the cache is full,
+// else a fresh one. Caller holds pcache.lock.
+static struct cpage*
+pcalloc(void)
+{
+  struct cpage *pg;
+
+  if(pcache.npage >= PCMAX){
+    for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+      if(pg->ref == 0 && !pg->dirty && krefcnt(pg->data) == 1){
+        pcunlink(pg);
+        return pg;
+      }
+    }
+  }
+  if((pg = kmalloc(sizeof(struct cpage))) == NULL)
+    return NULL;
+  if((pg->data = kalloc()) == NULL){
+    kmfree(pg);
+    return NULL;
+  }
+  pcache.npage++;
+  return pg;
+}
+
+// Return page index of ep's file, holding a reference to it.
+// A page not yet cached is read from the disk, or zeroed if fill
+// is 0 because the caller is about to overwrite all of its data.
+// Returns 0 if out of memory or the read fails; the caller then
+// goes to the disk itself.
+// Caller must hold ep->lock.
+struct cpage*
+pcget(struct dirent *ep, uint index, int fill)
+{
+  struct cpage *pg;
+
+  acquire(&pcache.lock);
+  for(pg = *pchash(ep, index); pg; pg = pg->hnext){
+    if(pg->ep == ep && pg->index == index){
+      pg->ref++;
+      pg->next->prev = pg->prev;
+      pg->prev->next = pg->next;
+      pg->next = pcache.head.next;
+      pg->prev = &pcache.head;
+      pcache.head.next->prev = pg;
+      pcache.head.next = pg;
+      release(&pcache.lock);
+      return pg;
+    }
+  }
+  if((pg = pcalloc()) == NULL){
+    release(&pcache.lock);
+    return NULL;
+  }
+  pg->ep = ep;
+  pg->index = index;
+  pg->ref = 1;
+  pg->dirty = 0;
+  pclink(pg);
+  release(&pcache.lock);
+
+  // nobody else can look for it without ep->lock
+  if(fill == 0){
+    pagezero(pg->data);
+  } else if(epageio(ep, index * PGSIZE, pg->data, 0) < 0){
+    acquire(&pcache.lock);
+    pcunlink(pg);
+    pcache.npage--;
+    release(&pcache.lock);
+    kfree(pg->data);
+    kmfree(pg);
+    return NULL;
+  }
+  return pg;
+}
+
+// Queue a request for pcflushd. Caller holds ep->lock.
+// Returns 0, or -1 if the queue is full.
+static int
+pcqueue(struct dirent *ep, uint index)
+{
+  struct pcreq *r;
+
+  edup(ep);
+  acquire(&pcache.lock);
+  for(r = pcache.req; r < &pcache.req[NPCREQ]; r++){
+    if(r->ep == NULL){
+      r->ep = ep;
+      r->index = index;
+      r->when = index == PCWB ? ticks + PCDELAY : ticks;
+      pcache.nreq++;
+      wakeup(&pcache.req);
+      release(&pcache.lock);
+      return 0;
+    }
+  }
+  release(&pcache.lock);
+  eput(ep);     // not the last reference: the caller holds one
+  return -1;
+}
+
+// Drop the reference from pcget(); dirty says the caller
+// changed the data, which then gets written back in a while.
+// Caller must hold ep->lock.
+void
+pcput(struct cpage *pg, int dirty)
+{
+  struct dirent *ep = pg->ep;
+
+  acquire(&pcache.lock);
+  pg->ref--;
+  if(dirty && !pg->dirty){
+    pg->dirty = 1;
+    pcache.ndirty++;
+  }
+  release(&pcache.lock);
+  if(dirty && !ep->wbqueued){
+    if(pcqueue(ep, PCWB) == 0)
+      ep->wbqueued = 1;
+    else
+      pcflush(ep);      // pcflushd is swamped, do it ourselves
+  }
+}
+
+// Write ep's dirty pages back to the disk (well, the buffer cache).
+// Caller must hold ep->lock.
+void
+pcflush(struct dirent *ep)
+{
+  struct cpage *pg;
+
+  acquire(&pcache.lock);
+  for(pg = ep->pages; pg; pg = pg->enext){
+    if(!pg->dirty)
+      continue;
+    pg->dirty = 0;
+    pcache.ndirty--;
+    pg->ref++;          // keeps pg, and so our place, in ep's list
+    release(&pcache.lock);
+    // a removed file's data is going nowhere
+    if(ep->valid == 1 && epageio(ep, pg->index * PGSIZE, pg->data, 1) < 0)
+      printf("pcflush: write-back of %s failed\n", ep->filename);
+    acquire(&pcache.lock);
+    pg->ref--;
+  }
+  release(&pcache.lock);
+}
+
+// Forget ep's pages, dirty or not, because its file is being
+// truncated or the entry reused. Mapped pages live on for their
+// mappings. Caller must hold ep->lock, or ep must be unused.
+void
+pcdrop(struct dirent *ep)
+{
+  struct cpage *pg;
+
+  acquire(&pcache.lock);
+  while((pg = ep->pages) != NULL){
+    if(pg->ref)
+      panic("pcdrop: busy");
+    if(pg->dirty)
+      pcache.ndirty--;
+    pcunlink(pg);
+    pcache.npage--;
+    kfree(pg->data);
+    kmfree(pg);
+  }
+  release(&pcache.lock);
+}
+
+// eread() is about to read page index of ep. Once it has read
+// pages one after another, keep pcflushd reading PCRA pages
+// ahead of it. Caller must hold ep->lock.
+void
+pcreadahead(struct dirent *ep, uint index)
+{
+  if(index != ep->raseq){
+    // not sequential: wait until it is
+    ep->raseq = index + 1;
+    ep->ranext = index + 1;
+    return;
+  }
+  ep->raseq = index + 1;
+  if(ep->ranext <= index)
+    ep->ranext = index + 1;
+  if(ep->ranext - index <= PCRA / 2 && (uint64)ep->ranext * PGSIZE < ep->file_size &&
+     pcqueue(ep, ep->ranext) == 0)
+    ep->ranext += PCRA;
+}
+
+// Make every queued write-back due now, and wait until pcflushd
+// is through with the queue, so that no page is dirty. Caller
+// must not hold any entry's lock.
+void
+pcsync(void)
+{
+  struct pcreq *r;
+
+  acquire(&pcache.lock);
+  for(r = pcache.req; r < &pcache.req[NPCREQ]; r++){
+    if(r->ep)
+      r->when = ticks;
+  }
+  wakeup(&pcache.req);
+  while(pcache.nreq > 0)
+    sleep(&pcache.nreq, &pcache.lock);
+  release(&pcache.lock);
+}
+
+// The page cache's kernel thread: carries out the requests that
+// are due, and sleeps a tick at a time while write-backs wait.
+static void
+pcflushd(void)
+{
+  struct pcreq *r, req;
+  int waiting;
+  uint i;
+
+  acquire(&pcache.lock);
+  for(;;){
+    waiting = 0;
+    for(r = pcache.req; r < &pcache.req[NPCREQ]; r++){
+      if(r->ep && (int)(ticks - r->when) >= 0)
+        break;
+      if(r->ep)
+        waiting = 1;
+    }
+    if(r == &pcache.req[NPCREQ]){
+      if(waiting){
+        release(&pcache.lock);
+        acquire(&tickslock);
+        sleep(&ticks, &tickslock);
+        release(&tickslock);
+        acquire(&pcache.lock);
+      } else {
+        sleep(&pcache.req, &pcache.lock);
+      }
+      continue;
+    }
+    req = *r;
+    r->ep = NULL;
+    release(&pcache.lock);
+
+    elock(req.ep);
+    if(req.index == PCWB){
+      req.ep->wbqueued = 0;
+      pcflush(req.ep);
+    } else if(req.ep->valid == 1){
+      for(i = req.index; i < req.index + PCRA && (uint64)i * PGSIZE < req.ep->file_size; i++){
+        struct cpage *pg = pcget(req.ep, i, 1);
+        if(pg == NULL)
+          break;
+        pcput(pg, 0);
+      }
+    }
+    eunlock(req.ep);
+    eput(req.ep);
+
+    acquire(&pcache.lock);
+    pcache.nreq--;
+    wakeup(&pcache.nreq);
+  }
+}
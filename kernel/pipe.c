@@ -7,7 +7,7 @@
 #include "include/sleeplock.h"
 #include "include/file.h"
 #include "include/pipe.h"
-#include "include/kalloc.h"
+#include "include/kmalloc.h"
 #include "include/vm.h"
 
 int
@@ -19,7 +19,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == NULL || (*f1 = filealloc()) == NULL)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == NULL)
+  if((pi = (struct pipe*)kmalloc(sizeof(struct pipe))) == NULL)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -38,7 +38,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kmfree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -59,44 +59,51 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kmfree(pi);
   } else
     release(&pi->lock);
 }
 
+// User data goes through a buffer on the kernel stack, PIPECHUNK
+// bytes at a time, so that it is never copied under pi->lock: the
+// user's page may have to be swapped in, which sleeps.
+#define PIPECHUNK 128
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i, j, m;
+  char buf[PIPECHUNK];
   struct proc *pr = myproc();
 
-  acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || pr->killed){
-        release(&pi->lock);
-        return -1;
+  for(i = 0; i < n; i += m){
+    m = n - i < PIPECHUNK ? n - i : PIPECHUNK;
+    if(copyin2(buf, addr + i, m) == -1)
+      break;
+    acquire(&pi->lock);
+    for(j = 0; j < m; j++){
+      while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+        if(pi->readopen == 0 || pr->killed){
+          release(&pi->lock);
+          return -1;
+        }
+        wakeup(&pi->nread);
+        sleep(&pi->nwrite, &pi->lock);
       }
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
+      pi->data[pi->nwrite++ % PIPESIZE] = buf[j];
     }
-    // if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-    if(copyin2(&ch, addr + i, 1) == -1)
-      break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    wakeup(&pi->nread);
+    release(&pi->lock);
   }
-  wakeup(&pi->nread);
-  release(&pi->lock);
   return i;
 }
 
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, m;
+  char buf[PIPECHUNK];
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -106,15 +113,17 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    // if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-    if(copyout2(addr + i, &ch, 1) == -1)
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
+    for(m = 0; m < PIPECHUNK && i + m < n && pi->nread != pi->nwrite; m++)
+      buf[m] = pi->data[pi->nread++ % PIPESIZE];
+    if(m == 0)
       break;
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+    release(&pi->lock);
+    if(copyout2(addr + i, buf, m) == -1)
+      return i;
+    acquire(&pi->lock);
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
@@ -13,7 +13,12 @@
 //
 
 void plicinit(void) {
+	#ifdef QEMU
+	for (int n = 0; n < NVIRTIO; n++)
+		writed(1, PLIC_V + (VIRTIO0_IRQ + n) * sizeof(uint32));
+	#else
 	writed(1, PLIC_V + DISK_IRQ * sizeof(uint32));
+	#endif
 	writed(1, PLIC_V + UART_IRQ * sizeof(uint32));
 
 	#ifdef DEBUG 
@@ -29,7 +34,7 @@ plicinithart(void)
   // set uart's enable bit for this hart's S-mode. 
   printf("plicinithart_in\n ");
 
-  *(uint32*)PLIC_SENABLE(hart)= (1 << UART_IRQ) | (1 << DISK_IRQ);
+  *(uint32*)PLIC_SENABLE(hart)= (1 << UART_IRQ) | (((1 << NVIRTIO) - 1) << VIRTIO0_IRQ);
   printf("plicinithart_in\n ");
   
   // set this hart's S-mode priority threshold to 0.
@@ -13,6 +13,8 @@
 #include "include/file.h"
 #include "include/trap.h"
 #include "include/vm.h"
+#include "include/vma.h"
+#include "include/mman.h"
 
 
 struct cpu cpus[NCPU];
@@ -25,6 +27,8 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+extern int exec(char *path, char **argv);
+static void spawnret(void);
 extern void swtch(struct context*, struct context*);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
@@ -58,16 +62,15 @@ procinit(void)
       initlock(&p->lock, "proc");
 
       // Allocate a page for the process's kernel stack.
-      // Map it high in memory, followed by an invalid
-      // guard page.
-      // char *pa = kalloc();
-      // // printf("[procinit]kernel stack: %p\n", (uint64)pa);
-      // if(pa == 0)
-      //   panic("kalloc");
-      // uint64 va = KSTACK((int) (p - proc));
-      // // printf("[procinit]kvmmap va %p to pa %p\n", va, (uint64)pa);
-      // kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-      // p->kstack = va;
+      // Map it high in memory, above an invalid
+      // guard page. Every user page table shares
+      // this part of the kernel page table.
+      char *pa = kalloc();
+      if(pa == 0)
+        panic("kalloc");
+      uint64 va = KSTACK((int) (p - proc));
+      kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+      p->kstack = va;
   }
   //kvminithart();
 
@@ -148,15 +151,15 @@ found:
   }
 
   // An empty user page table.
-  // And an identical kernel page table for this proc.
-  if ((p->pagetable = proc_pagetable(p)) == NULL ||
-      (p->kpagetable = proc_kpagetable()) == NULL) {
+  if((p->pagetable = proc_pagetable(p)) == NULL){
     freeproc(p);
     release(&p->lock);
     return NULL;
   }
 
-  p->kstack = VKSTACK;
+  p->vma = NULL;
+  p->asid = 0;      // take a fresh ASID when first scheduled
+  p->lastcpu = -1;
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -176,10 +179,6 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if (p->kpagetable) {
-    kvmfree(p->kpagetable, 1);
-  }
-  p->kpagetable = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -190,6 +189,8 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->spawnpath = 0;
+  p->spawnargv = 0;
   p->state = UNUSED;
 }
 
@@ -280,6 +281,40 @@ uchar initcode[] = {
 //   printf("[test_proc]test_proc init done\n");
 // }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch to kthreadstart.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn(), which must never return.
+// It has no user memory, and init for a parent.
+// Returns its pid, or -1.
+int
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == NULL)
+    return -1;
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadstart;
+  p->parent = initproc;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  p->state = RUNNABLE;
+  release(&p->lock);
+  return pid;
+}
+
 // Set up first user process.
 void
 userinit(void)
@@ -291,7 +326,7 @@ userinit(void)
   
   // allocate one user page and copy init's instructions
   // and data into it.
-  uvminit(p->pagetable , p->kpagetable, initcode, sizeof(initcode));
+  uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
@@ -315,16 +350,19 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, p->kpagetable, sz, sz + n)) == 0) {
+    // Only reserve the address space; the pages are
+    // allocated by uvmfault() when first touched.
+    if(sz + n > vmalowest(p->vma))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, p->kpagetable, sz, sz + n);
+    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    vmatrim(&p->vma, sz);
   }
   p->sz = sz;
   return 0;
@@ -338,6 +376,7 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct vma *v;
 
   // Allocate process.
   if((np = allocproc()) == NULL){
@@ -345,12 +384,25 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, 0, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  // The parent holds the same files, so vmafree() can't drop
+  // a last reference and sleep here.
+  if(vmadup(&np->vma, p->vma) < 0)
+    goto bad;
+  // Private mmap() regions lie above sz; share their pages the
+  // same way. The child faults shared ones back in from the page
+  // cache or the segment, rather than marking them copy-on-write:
+  // every page of a shared file mapping is the file's cached page
+  // (see vmapage()), so both processes see the same pages.
+  for(v = np->vma; v; v = v->next){
+    if((v->flags & MAP_PRIVATE) && uvmcopy(p->pagetable, np->pagetable, v->start, v->end) < 0)
+      goto bad;
+  }
 
   np->parent = p;
 
@@ -377,9 +429,95 @@ fork(void)
 
   release(&np->lock);
 
+  return pid;
+
+ bad:
+  for(v = np->vma; v; v = v->next){
+    if(v->flags)
+      vmunmap(np->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  }
+  vmafree(&np->vma);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
+// Create a new process running path with argv, without copying
+// the parent's memory the way fork() and exec() would. The child
+// runs exec() itself, from its first scheduling, while the parent
+// waits, as after vfork(); path and argv stay in the parent's kernel
+// memory, which every page table maps. Returns the child's pid, or
+// -1 if it couldn't be created or exec() failed.
+int
+spawn(char *path, char **argv)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == NULL)
+    return -1;
+
+  np->parent = p;
+  np->tmask = p->tmask;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = edup(p->cwd);
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  np->spawnpath = path;
+  np->spawnargv = argv;
+  np->context.ra = (uint64)spawnret;
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  // spawnret() clears spawnpath holding our lock, and exit()
+  // wakes us too, so neither can be missed.
+  acquire(&p->lock);
+  while(np->spawnpath){
+    acquire(&np->lock);
+    if(np->state == ZOMBIE){
+      // exec() failed: nobody else is to see the child
+      freeproc(np);
+      release(&np->lock);
+      pid = -1;
+      break;
+    }
+    release(&np->lock);
+    sleep(p, &p->lock);
+  }
+  release(&p->lock);
+
   return pid;
 }
 
+// A spawn() child's first scheduling by scheduler()
+// will swtch to spawnret.
+static void
+spawnret(void)
+{
+  struct proc *p = myproc();
+  int argc;
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  if((argc = exec(p->spawnpath, p->spawnargv)) < 0)
+    exit(-1);
+  p->trapframe->a0 = argc;
+
+  // The parent is waiting in spawn(), so it can't go away.
+  acquire(&p->parent->lock);
+  p->spawnpath = 0;
+  p->spawnargv = 0;
+  wakeup1(p->parent);
+  release(&p->parent->lock);
+
+  usertrapret();
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -428,6 +566,8 @@ exit(int status)
 
   eput(p->cwd);
   p->cwd = 0;
+  uvmmunmap(p, 0, MAXUVA);
+  vmafree(&p->vma);
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
@@ -476,7 +616,7 @@ int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   // hold p->lock for the whole time to avoid lost
@@ -498,14 +638,13 @@ wait(uint64 addr)
         if(np->state == ZOMBIE){
           // Found one.
           pid = np->pid;
-          if(addr != 0 && copyout2(addr, (char *)&np->xstate, sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
+          xstate = np->xstate;
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
+          // not under the locks: the page may have to be swapped in
+          if(addr != 0 && copyout2(addr, (char *)&xstate, sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&np->lock);
@@ -535,7 +674,6 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  extern pagetable_t kernel_pagetable;
 
   c->proc = 0;
   for(;;){
@@ -552,11 +690,9 @@ scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
-        w_satp(MAKE_SATP(p->kpagetable));
-        sfence_vma();
+        uvmswitch(p);
         swtch(&c->context, &p->context);
-        w_satp(MAKE_SATP(kernel_pagetable));
-        sfence_vma();
+        kvmswitch();
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -565,7 +701,9 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if(found == 0) {
+    // Nothing to run: spend the time zeroing pages for
+    // kzalloc(), and only sleep once that pool is full.
+    if(found == 0 && kzfill() == 0) {
       intr_on();
       asm volatile("wfi");
     }
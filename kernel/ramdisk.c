@@ -0,0 +1,141 @@
+// Memory-backed block device.
+//
+// RAMDISK_SIZE bytes of kalloc()ed pages, formatted as an empty
+// FAT32 volume at boot. Mount it for scratch data that should not
+// touch the real disk, or to measure the file system without the
+// cost of a device.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/buf.h"
+#include "include/disk.h"
+#include "include/kalloc.h"
+#include "include/string.h"
+#include "include/printf.h"
+#include "include/fat32.h"
+#include "include/ramdisk.h"
+
+#define SECT_PER_PAGE   (PGSIZE / BSIZE)
+#define RAMDISK_NPAGE   (RAMDISK_SIZE / PGSIZE)
+#define RAMDISK_NSEC    (RAMDISK_NPAGE * SECT_PER_PAGE)
+
+// boot sector and FSInfo sector
+#define RSVD_SEC_CNT    2
+
+static struct {
+    char *pages[RAMDISK_NPAGE + 1];     // + 1 keeps the array legal when the size is 0
+    int npage;
+} ramdisk;
+
+static uchar *ramdisk_sector(uint sectorno)
+{
+    if (sectorno >= ramdisk.npage * SECT_PER_PAGE)
+        panic("ramdisk: sector out of range");
+    return (uchar *)ramdisk.pages[sectorno / SECT_PER_PAGE] + (sectorno % SECT_PER_PAGE) * BSIZE;
+}
+
+// Copying is all there is to do, the buf's sleeplock
+// keeps concurrent requests for one sector apart.
+static void ramdisk_rw(struct blkdev *bd, struct buf *b, int write)
+{
+    uchar *p = ramdisk_sector(b->sectorno);
+
+    if (write)
+        memmove(p, b->data, BSIZE);
+    else
+        memmove(b->data, p, BSIZE);
+}
+
+static struct blkdev_ops ramdisk_ops = {
+    .rw = ramdisk_rw,
+};
+
+// the on-disk format is little-endian and mostly misaligned
+static void put16(uchar *p, uint16 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uchar *p, uint32 v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+// Lay down an empty FAT32 volume: one sector per cluster, a single
+// FAT and a root directory in cluster 2. Pages are already zeroed.
+static void ramdisk_format(uint32 nsec)
+{
+    uint32 fat_sz = ((nsec - RSVD_SEC_CNT) * 4 + 8 + BSIZE - 1) / BSIZE;
+    uint32 data_clus_cnt = nsec - RSVD_SEC_CNT - fat_sz;
+    uchar *bs = ramdisk_sector(0);
+    uchar *fsinfo = ramdisk_sector(1);
+
+    bs[0] = 0xeb;                               // jmp, so that tools take it as a boot sector
+    bs[1] = 0x58;
+    bs[2] = 0x90;
+    memmove(bs + 3, "XV6RAMFS", 8);
+    put16(bs + 11, BSIZE);                      // bytes per sector
+    bs[13] = 1;                                 // sectors per cluster
+    put16(bs + 14, RSVD_SEC_CNT);
+    bs[16] = 1;                                 // number of FATs
+    bs[21] = 0xf8;                              // media: fixed disk
+    put32(bs + 32, nsec);                       // total sectors
+    put32(bs + 36, fat_sz);
+    put32(bs + 44, 2);                          // root cluster
+    put16(bs + 48, 1);                          // FSInfo sector
+    bs[66] = 0x29;                              // extended boot signature
+    memmove(bs + 71, "RAMDISK    ", CHAR_SHORT_NAME);
+    memmove(bs + 82, "FAT32   ", 8);
+    bs[510] = 0x55;
+    bs[511] = 0xaa;
+
+    put32(fsinfo, 0x41615252);
+    put32(fsinfo + 484, 0x61417272);
+    put32(fsinfo + 488, 0xffffffff);            // free count unknown
+    put32(fsinfo + 492, 0xffffffff);            // no hint for the next free cluster
+    put32(fsinfo + 508, 0xaa550000);
+
+    // Entries 0 and 1 are reserved, 2 ends the root directory's chain.
+    // Entries past the last cluster share the FAT's last sector; mark
+    // them bad so that the allocator's linear scan never hands them out.
+    uint32 const ent_per_sec = BSIZE / sizeof(uint32);
+    for (uint32 i = 0; i < fat_sz * ent_per_sec; i++) {
+        uint32 v;
+        if (i == 0)
+            v = 0x0ffffff8;
+        else if (i <= 2)
+            v = 0x0fffffff;
+        else if (i < data_clus_cnt + 2)
+            continue;
+        else
+            v = 0x0ffffff7;
+        put32(ramdisk_sector(RSVD_SEC_CNT + i / ent_per_sec) + (i % ent_per_sec) * 4, v);
+    }
+}
+
+void ramdisk_init(void)
+{
+    if (RAMDISK_NPAGE == 0)
+        return;
+    for (ramdisk.npage = 0; ramdisk.npage < RAMDISK_NPAGE; ramdisk.npage++) {
+        char *pa = kalloc();
+        if (pa == NULL) {
+            printf("ramdisk: out of memory\n");
+            goto fail;
+        }
+        pagezero(pa);
+        ramdisk.pages[ramdisk.npage] = pa;
+    }
+    ramdisk_format(RAMDISK_NSEC);
+    // no queue to speak of, let every buffer in at once
+    if (disk_register("ramdisk", &ramdisk_ops, 0, RAMDISK_NSEC, NBUF, 0) < 0)
+        goto fail;
+    return;
+
+fail:
+    while (ramdisk.npage > 0)
+        kfree(ramdisk.pages[--ramdisk.npage]);
+}
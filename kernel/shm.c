@@ -0,0 +1,135 @@
+// Shared-memory segments.
+//
+// shmget() finds or creates a segment by key, shmat() maps all of
+// its pages into the calling process as a vma, and shmdt() (or
+// munmap(), exit(), exec()) takes the mapping away again. fork()
+// passes attachments on. A segment is freed when its last
+// attachment goes; one that was never attached stays until it is.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/kalloc.h"
+#include "include/shm.h"
+#include "include/printf.h"
+
+static struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+static void
+shmfree(struct shm *s)
+{
+  for(int i = 0; i < s->npage; i++)
+    kfree(s->pages[i]);
+  s->used = 0;
+}
+
+// Return the id of key's segment of at least size bytes, creating
+// it if flags has IPC_CREAT, or -1.
+int
+shmcreate(int key, uint64 size, int flags)
+{
+  struct shm *s;
+  uint npage;
+
+  if(size == 0 || size > SHMMAXPG * PGSIZE)
+    return -1;
+  npage = PGROUNDUP(size) / PGSIZE;
+
+  acquire(&shmtab.lock);
+  if(key != IPC_PRIVATE){
+    for(s = shmtab.shm; s < &shmtab.shm[NSHM]; s++){
+      if(s->used && s->key == key){
+        if(((flags & IPC_CREAT) && (flags & IPC_EXCL)) || npage > s->npage)
+          goto bad;
+        release(&shmtab.lock);
+        return s - shmtab.shm;
+      }
+    }
+    if((flags & IPC_CREAT) == 0)
+      goto bad;
+  }
+  for(s = shmtab.shm; s < &shmtab.shm[NSHM]; s++){
+    if(s->used == 0)
+      break;
+  }
+  if(s == &shmtab.shm[NSHM])
+    goto bad;
+  s->npage = 0;
+  while(s->npage < npage){
+    if((s->pages[s->npage] = kzalloc()) == NULL){
+      shmfree(s);
+      goto bad;
+    }
+    s->npage++;
+  }
+  s->used = 1;
+  s->key = key;
+  s->ref = 0;
+  release(&shmtab.lock);
+  return s - shmtab.shm;
+
+ bad:
+  release(&shmtab.lock);
+  return -1;
+}
+
+// Take an attachment of segment id, or return 0 if there is none.
+struct shm*
+shmattach(int id)
+{
+  struct shm *s;
+
+  if(id < 0 || id >= NSHM)
+    return NULL;
+  s = &shmtab.shm[id];
+  acquire(&shmtab.lock);
+  if(s->used == 0){
+    release(&shmtab.lock);
+    return NULL;
+  }
+  s->ref++;
+  release(&shmtab.lock);
+  return s;
+}
+
+// Another attachment of s, for a copied or split vma.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  s->ref++;
+  release(&shmtab.lock);
+}
+
+// Drop an attachment of s; the last one frees it.
+void
+shmput(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(s->ref < 1)
+    panic("shmput");
+  if(--s->ref == 0)
+    shmfree(s);
+  release(&shmtab.lock);
+}
+
+// Page index of s, with a page reference for the caller to map it
+// by. The caller holds an attachment, so the page stays put.
+char*
+shmpage(struct shm *s, uint index)
+{
+  if(index >= s->npage)
+    return NULL;
+  krefinc(s->pages[index]);
+  return s->pages[index];
+}
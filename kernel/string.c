@@ -1,13 +1,41 @@
 #include "include/types.h"
+#include "include/riscv.h"
+#include "include/string.h"
+
+// memset(), memmove() and memcmp() work a 64-bit word at a time
+// wherever the alignment of their pointers allows, eight words to
+// a loop iteration, and byte by byte only for the ends. memmove()
+// and memcmp() can only do so when both pointers are equally far
+// from a word boundary. pagezero() and pagecopy() are for whole,
+// aligned pages and skip the checks.
+
+#define WSIZE   sizeof(uint64)
+#define WMASK   (WSIZE - 1)
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *cdst = (uchar *) dst;
+  uint64 *wdst, w;
+
+  for(; n > 0 && ((uint64)cdst & WMASK); n--)
+    *cdst++ = c;
+  if(n >= WSIZE){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wdst = (uint64 *) cdst;
+    for(; n >= 8 * WSIZE; n -= 8 * WSIZE, wdst += 8){
+      wdst[0] = w; wdst[1] = w; wdst[2] = w; wdst[3] = w;
+      wdst[4] = w; wdst[5] = w; wdst[6] = w; wdst[7] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wdst++ = w;
+    cdst = (uchar *) wdst;
   }
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +46,16 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if((((uint64)s1 ^ (uint64)s2) & WMASK) == 0){
+    for(; n > 0 && ((uint64)s1 & WMASK); n--, s1++, s2++){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    }
+    // the bytes of the first word that differs are left
+    // for the loop below to tell apart
+    for(; n >= WSIZE && *(uint64 *)s1 == *(uint64 *)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,21 +70,85 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  const uint64 *ws;
+  uint64 *wd;
+  int aligned;
 
   s = src;
   d = dst;
+  aligned = (((uint64)s ^ (uint64)d) & WMASK) == 0;
   if(s < d && s + n > d){
+    // overlapping with dst above src: copy from the end
     s += n;
     d += n;
+    if(aligned){
+      for(; n > 0 && ((uint64)d & WMASK); n--)
+        *--d = *--s;
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 8 * WSIZE; n -= 8 * WSIZE){
+        ws -= 8;
+        wd -= 8;
+        wd[7] = ws[7]; wd[6] = ws[6]; wd[5] = ws[5]; wd[4] = ws[4];
+        wd[3] = ws[3]; wd[2] = ws[2]; wd[1] = ws[1]; wd[0] = ws[0];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *--wd = *--ws;
+      s = (const char *) ws;
+      d = (char *) wd;
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(aligned){
+      for(; n > 0 && ((uint64)d & WMASK); n--)
+        *d++ = *s++;
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 8 * WSIZE; n -= 8 * WSIZE, ws += 8, wd += 8){
+        wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+        wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      s = (const char *) ws;
+      d = (char *) wd;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
 
+// Zero the page at pa, which must be page-aligned.
+void
+pagezero(void *pa)
+{
+  uint64 *w = (uint64 *) pa;
+  uint64 *end = w + PGSIZE / WSIZE;
+
+  for(; w < end; w += 8){
+    w[0] = 0; w[1] = 0; w[2] = 0; w[3] = 0;
+    w[4] = 0; w[5] = 0; w[6] = 0; w[7] = 0;
+  }
+}
+
+// Copy the page at src to the page at dst, which must both be
+// page-aligned, and not the same.
+void
+pagecopy(void *dst, const void *src)
+{
+  uint64 *wd = (uint64 *) dst;
+  const uint64 *ws = (const uint64 *) src;
+  uint64 *end = wd + PGSIZE / WSIZE;
+
+  for(; wd < end; wd += 8, ws += 8){
+    wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+    wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+  }
+}
+
 // memcpy exists to placate GCC.  Use memmove.
 void*
 memcpy(void *dst, const void *src, uint n)
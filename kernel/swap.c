@@ -0,0 +1,295 @@
+// Paging out to a swap file.
+//
+// Once swapon() has named a file, allocating user memory (see
+// uvmkalloc()) no longer fails as soon as kalloc() runs dry: it
+// has swapout() write a cold page to a 4 KB slot of the file and
+// free it instead. The page's PTE keeps the slot number, with
+// PTE_SWAP in place of PTE_V, and uvmfault() reads the page back
+// with swapin() when it is next touched.
+//
+// Victims are chosen by the clock algorithm. The hand sweeps over
+// the user pages of every process that isn't running on another
+// hart. A page with PTE_A set gets a second chance: the bit is
+// cleared, for the hardware to set again if the page is used
+// before the hand comes back. A page found with PTE_A clear goes.
+// Only anonymous pages with a single reference are paged out: the
+// page cache's pages, file mappings, shared-memory segments and
+// pages still shared copy-on-write stay where they are.
+//
+// Slots are reference counted, because fork() shares a paged-out
+// page by copying its PTE. swap.lock protects the slots and the
+// statistics; swap.clock, a sleeplock, the hand.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/proc.h"
+#include "include/fat32.h"
+#include "include/kalloc.h"
+#include "include/pcache.h"
+#include "include/vm.h"
+#include "include/vma.h"
+#include "include/mman.h"
+#include "include/swap.h"
+#include "include/sysinfo.h"
+#include "include/printf.h"
+
+extern struct proc proc[NPROC];
+
+static struct {
+  struct spinlock lock;
+  struct dirent *ep;            // the swap file, 0 until swapon()
+  uint nslot;
+  uint nused;
+  uint next;                    // where to look for a free slot
+  ushort ref[NSWAP];            // PTEs holding each slot
+  uchar busy[NSWAP];            // being written by swapout()
+  uint64 nin;                   // pages read back in
+  uint64 nout;                  // pages written out
+
+  struct sleeplock clock;
+  int hand;                     // index in proc[] of the process
+  uint64 handva;                // and the page of it the hand is at
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.clock, "swapclock");
+}
+
+// Start paging out to the file at path. All of it, up to NSWAP
+// pages, becomes swap space, written in place. Only one swap
+// file can be on at a time, for good.
+// Returns 0, or -1.
+int
+swapon(char *path)
+{
+  struct dirent *ep;
+  uint n;
+
+  if((ep = ename(path)) == NULL)
+    return -1;
+  elock(ep);
+  n = ep->file_size / PGSIZE;
+  if((ep->attribute & ATTR_DIRECTORY) || n == 0){
+    eunlock(ep);
+    eput(ep);
+    return -1;
+  }
+  // the slots bypass the page cache; get it out of the way
+  pcflush(ep);
+  pcdrop(ep);
+  eunlock(ep);
+
+  acquire(&swap.lock);
+  if(swap.ep){
+    release(&swap.lock);
+    eput(ep);
+    return -1;
+  }
+  swap.ep = ep;                 // keeps the reference
+  swap.nslot = n < NSWAP ? n : NSWAP;
+  release(&swap.lock);
+  printf("swapon: %s, %d KB\n", path, swap.nslot * (PGSIZE >> 10));
+  return 0;
+}
+
+// Take a free slot for swapout(), busy until it's written.
+// Returns it, or -1 if the swap file is full.
+static int
+slotalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.ref[s] == 0 && !swap.busy[s]){
+      swap.ref[s] = 1;
+      swap.busy[s] = 1;
+      swap.nused++;
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE holds slot, in a child of fork().
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE holding slot is gone. The slot is free again once the
+// last one is, and swapout() is through writing it.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Can the hand take pages from p? Not while it runs on another
+// hart, nor while the kernel is using its pages directly (see
+// uvmtouch()). The process that wants the memory is fair game.
+// Caller holds p->lock.
+static int
+swappable(struct proc *p)
+{
+  if(p->pagetable == 0 || p->kfn || p->pin)
+    return 0;
+  return p == myproc() || p->state == SLEEPING || p->state == RUNNABLE;
+}
+
+// Move the hand through the pages of proc[swap.hand] from
+// swap.handva on, to the first one whose second chance is over,
+// and take it away from the process in favour of slot. Returns
+// the page, or 0 if the hand went past the end of the process.
+// Caller holds swap.clock.
+static char*
+sweep(uint slot)
+{
+  struct proc *p = &proc[swap.hand];
+  uint64 va = swap.handva;
+  struct vma *v;
+  pte_t *pte;
+  char *pa = 0;
+  int aged = 0;
+
+  acquire(&p->lock);
+  if(swappable(p)){
+    for(; (pte = uvmnext(p->pagetable, &va)) != NULL; va += PGSIZE){
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        aged = 1;
+        continue;
+      }
+      if(krefcnt((void*)PTE2PA(*pte)) != 1)
+        continue;
+      // only anonymous memory: a shared file page filled
+      // privately would lose the PTE_D that uvmmunmap() writes
+      // it back by
+      if((v = vmafind(p->vma, va)) != NULL && (v->ep || (v->flags & MAP_SHARED)))
+        continue;
+      pa = (char*)PTE2PA(*pte);
+      *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A|PTE_D)) | PTE_SWAP;
+      va += PGSIZE;
+      break;
+    }
+    // TLB entries of p may still have PTE_A set, or map pa.
+    // Ours can be flushed; another's are left behind by giving
+    // it a fresh ASID (see uvmswitch()).
+    if((aged || pa) && p == myproc())
+      sfence_vma_asid(SATP_ASID(r_satp()));
+    else if(aged || pa)
+      p->asid = 0;
+  }
+  release(&p->lock);
+
+  if(pa){
+    swap.handva = va;
+  } else {
+    swap.hand = (swap.hand + 1) % NPROC;
+    swap.handva = 0;
+  }
+  return pa;
+}
+
+// Page out one cold page of some process and free it.
+// Returns 0, or -1 if there is no swap file, it is full, or
+// there is nothing to page out. May sleep.
+int
+swapout(void)
+{
+  char *pa = 0;
+  int slot, n;
+
+  if(swap.ep == NULL || (slot = slotalloc()) < 0)
+    return -1;
+
+  // Two turns of the hand age every page and then find one
+  // that hasn't been used since, if there is any.
+  acquiresleep(&swap.clock);
+  for(n = 0; n <= 2 * NPROC && pa == 0; n++)
+    pa = sweep(slot);
+  releasesleep(&swap.clock);
+
+  if(pa == 0){
+    acquire(&swap.lock);
+    swap.ref[slot] = 0;
+    swap.busy[slot] = 0;
+    swap.nused--;
+    release(&swap.lock);
+    return -1;
+  }
+
+  elock(swap.ep);
+  // the page's owner has nothing else to go on
+  if(epageio(swap.ep, slot * PGSIZE, pa, 1) < 0)
+    panic("swapout: write");
+  eunlock(swap.ep);
+  kfree(pa);
+
+  acquire(&swap.lock);
+  swap.busy[slot] = 0;
+  swap.nout++;
+  wakeup(&swap.busy);
+  release(&swap.lock);
+  return 0;
+}
+
+// Read the page in slot into mem, giving up the slot's
+// reference held by the PTE it is for. May sleep.
+// Returns 0, or -1 if the read failed.
+int
+swapin(uint slot, char *mem)
+{
+  int r;
+
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapin");
+  while(swap.busy[slot])
+    sleep(&swap.busy, &swap.lock);
+  release(&swap.lock);
+
+  elock(swap.ep);
+  r = epageio(swap.ep, slot * PGSIZE, mem, 0);
+  eunlock(swap.ep);
+  if(r < 0)
+    return -1;
+
+  swapfree(slot);
+  acquire(&swap.lock);
+  swap.nin++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Fill in the swap statistics of info.
+void
+swapinfo(struct sysinfo *info)
+{
+  acquire(&swap.lock);
+  info->swapsize = (uint64)swap.nslot * PGSIZE;
+  info->swapused = (uint64)swap.nused * PGSIZE;
+  info->swapins = swap.nin;
+  info->swapouts = swap.nout;
+  release(&swap.lock);
+}
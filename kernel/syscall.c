@@ -7,6 +7,7 @@
 #include "include/proc.h"
 #include "include/syscall.h"
 #include "include/sysinfo.h"
+#include "include/swap.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
 #include "include/string.h"
@@ -19,10 +20,7 @@
 int
 fetchaddr(uint64 addr, uint64 *ip)
 {
-  struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
-    return -1;
-  // if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
+  // copyin2() checks addr, which may be in an mmap() region
   if(copyin2((char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
   return 0;
@@ -119,6 +117,19 @@ extern uint64 sys_remove(void);
 extern uint64 sys_trace(void);
 extern uint64 sys_sysinfo(void);
 extern uint64 sys_rename(void);
+extern uint64 sys_blkctl(void);
+extern uint64 sys_mount(void);
+extern uint64 sys_umount(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_swapon(void);
+extern uint64 sys_membench(void);
 
 extern uint64 sys_getppid(void);
 
@@ -150,6 +161,19 @@ static uint64 (*syscalls[])(void) = {
   [SYS_trace]       sys_trace,
   [SYS_sysinfo]     sys_sysinfo,
   [SYS_rename]      sys_rename,
+  [SYS_blkctl]      sys_blkctl,
+  [SYS_mount]       sys_mount,
+  [SYS_umount]      sys_umount,
+  [SYS_fsync]       sys_fsync,
+  [SYS_sync]        sys_sync,
+  [SYS_mmap]        sys_mmap,
+  [SYS_munmap]      sys_munmap,
+  [SYS_shmget]      sys_shmget,
+  [SYS_shmat]       sys_shmat,
+  [SYS_shmdt]       sys_shmdt,
+  [SYS_spawn]       sys_spawn,
+  [SYS_swapon]      sys_swapon,
+  [SYS_membench]    sys_membench,
 
   [SYS_getppid]      sys_getppid,
 
@@ -182,6 +206,19 @@ static char *sysnames[] = {
   [SYS_trace]       "trace",
   [SYS_sysinfo]     "sysinfo",
   [SYS_rename]      "rename",
+  [SYS_blkctl]      "blkctl",
+  [SYS_mount]       "mount",
+  [SYS_umount]      "umount",
+  [SYS_fsync]       "fsync",
+  [SYS_sync]        "sync",
+  [SYS_mmap]        "mmap",
+  [SYS_munmap]      "munmap",
+  [SYS_shmget]      "shmget",
+  [SYS_shmat]       "shmat",
+  [SYS_shmdt]       "shmdt",
+  [SYS_spawn]       "spawn",
+  [SYS_swapon]      "swapon",
+  [SYS_membench]    "membench",
 };
 
 void
@@ -261,6 +298,8 @@ sys_sysinfo(void)
   struct sysinfo info;
   info.freemem = freemem_amount();
   info.nproc = procnum();
+  kalloc_fraginfo(info.nfree);
+  swapinfo(&info);
 
   // if (copyout(p->pagetable, addr, (char *)&info, sizeof(info)) < 0) {
   if (copyout2(addr, (char *)&info, sizeof(info)) < 0) {
@@ -20,6 +20,14 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
+#include "include/iostat.h"
+#include "include/disk.h"
+#include "include/buf.h"
+#include "include/memlayout.h"
+#include "include/vma.h"
+#include "include/mman.h"
+#include "include/pcache.h"
+#include "include/swap.h"
 
 
 // Fetch the nth word-sized system call argument as a file descriptor
@@ -336,7 +344,7 @@ sys_getcwd(void)
   if (argaddr(0, &addr) < 0)
     return -1;
 
-  struct dirent *de = myproc()->cwd;
+  struct dirent *de = emntpoint(myproc()->cwd);
   char path[FAT32_MAX_PATH];
   char *s;
   int len;
@@ -353,7 +361,7 @@ sys_getcwd(void)
         return -1;
       strncpy(s, de->filename, len);
       *--s = '/';
-      de = de->parent;
+      de = emntpoint(de->parent);
     }
   }
 
@@ -397,6 +405,10 @@ sys_remove(void)
   if((ep = ename(path)) == NULL){
     return -1;
   }
+  if(ep->parent == NULL){   // root of a volume
+    eput(ep);
+    return -1;
+  }
   elock(ep);
   if((ep->attribute & ATTR_DIRECTORY) && !isdirempty(ep)){
       eunlock(ep);
@@ -429,6 +441,9 @@ sys_rename(void)
       || (name = formatname(old)) == NULL) {
     goto fail;          // src doesn't exist || dst parent doesn't exist || illegal new name
   }
+  if (src->dev != pdst->dev) {
+    goto fail;          // no moving across volumes
+  }
   for (struct dirent *ep = pdst; ep != NULL; ep = ep->parent) {
     if (ep == src) {    // In what universe can we move a directory into its child?
       goto fail;
@@ -494,3 +509,180 @@ fail:
     eput(src);
   return -1;
 }
+
+// Block device control: polling mode and statistics.
+uint64
+sys_blkctl(void)
+{
+  int dev, cmd;
+  uint64 arg;
+
+  if(argint(0, &dev) < 0 || argint(1, &cmd) < 0 || argaddr(2, &arg) < 0)
+    return -1;
+
+  switch(cmd){
+    case BLK_POLL:
+      return disk_setpoll(dev, (int)arg);
+    case BLK_POLLSTAT: {
+      struct pollstat st;
+      if(disk_pollstat(dev, &st) < 0 || copyout2(arg, (char *)&st, sizeof(st)) < 0)
+        return -1;
+      return 0;
+    }
+    case BLK_STAT: {
+      struct iostat st;
+      if(disk_getstat(dev, &st) < 0 || copyout2(arg, (char *)&st, sizeof(st)) < 0)
+        return -1;
+      return 0;
+    }
+    case BLK_WBCACHE: {
+      int old = disk_setwbcache(dev, (int)arg);
+      if(old > 0 && (int)arg == 0)
+        bflush(dev);      // nothing may stay dirty behind a write-through cache
+      return old;
+    }
+    case BLK_INFO: {
+      struct blkinfo info;
+      if(disk_getinfo(dev, &info) < 0 || copyout2(arg, (char *)&info, sizeof(info)) < 0)
+        return -1;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Make the data and directory entry of an open file durable.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_ENTRY)
+    return -1;
+  elock(f->ep);
+  esync(f->ep);
+  eunlock(f->ep);
+  return 0;
+}
+
+// Write back every dirty page and buffer, and flush every disk.
+uint64
+sys_sync(void)
+{
+  struct blkinfo info;
+
+  pcsync();
+  for(int dev = 0; disk_getinfo(dev, &info) == 0; dev++)
+    bflush(dev);
+  return 0;
+}
+
+// Mount the FAT32 volume on block device dev over directory path.
+uint64
+sys_mount(void)
+{
+  char path[FAT32_MAX_PATH];
+  struct dirent *ep;
+  int dev;
+
+  if(argint(0, &dev) < 0 || argstr(1, path, FAT32_MAX_PATH) < 0)
+    return -1;
+  if((ep = ename(path)) == NULL)
+    return -1;
+  if(fat32_mount(dev, ep) < 0){
+    eput(ep);
+    return -1;
+  }
+  return 0;
+}
+
+uint64
+sys_umount(void)
+{
+  char path[FAT32_MAX_PATH];
+  struct dirent *ep;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0)
+    return -1;
+  // pcflushd's pending write-backs hold entries of the volume
+  pcsync();
+  if((ep = ename(path)) == NULL)
+    return -1;
+  if(fat32_umount(ep) < 0){
+    eput(ep);
+    return -1;
+  }
+  return 0;
+}
+
+// Page out to the file at path when memory runs short.
+uint64
+sys_swapon(void)
+{
+  char path[FAT32_MAX_PATH];
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0)
+    return -1;
+  return swapon(path);
+}
+
+// Map len bytes of fd from offset off, or zeros for MAP_ANONYMOUS,
+// into the top of the free address space. Pages are filled in by
+// uvmfault() when first touched. addr is only a hint, and ignored.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, off, start, low, filesz = 0;
+  int prot, flags;
+  struct file *f = NULL;
+  struct dirent *ep = NULL;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argaddr(5, &off) < 0)
+    return -1;
+  if(len == 0 || len > MAXUVA || off % PGSIZE != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+  if(flags & MAP_ANONYMOUS){
+    // without a file to write back to, shared would act as private
+    if(flags & MAP_SHARED)
+      return -1;
+  } else {
+    if(argfd(4, 0, &f) < 0 || f->type != FD_ENTRY || !f->readable)
+      return -1;
+    if((f->ep->attribute & ATTR_DIRECTORY) ||
+       ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable))
+      return -1;
+    ep = f->ep;
+    if(off < ep->file_size)
+      filesz = ep->file_size - off < len ? ep->file_size - off : len;
+  }
+
+  len = PGROUNDUP(len);
+  low = vmalowest(p->vma);
+  if(low - PGROUNDUP(p->sz) < len)
+    return -1;
+  start = low - len;
+  if(vmaadd(&p->vma, start, low, ep, off, filesz, prot,
+            flags & (MAP_SHARED|MAP_PRIVATE|MAP_ANONYMOUS)) < 0)
+    return -1;
+  return start;
+}
+
+// Unmap [addr, addr+len) of the mmap()ed regions, writing
+// shared file pages back.
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || len == 0 || addr >= MAXUVA || len > MAXUVA - addr)
+    return -1;
+  return uvmmunmap(myproc(), addr, PGROUNDUP(len));
+}
@@ -10,22 +10,32 @@
 #include "include/kalloc.h"
 #include "include/string.h"
 #include "include/printf.h"
+#include "include/vm.h"
+#include "include/vma.h"
+#include "include/mman.h"
+#include "include/shm.h"
 
 extern int exec(char *path, char **argv);
 
-uint64
-sys_exec(void)
+// Free the strings of an argv from fetchargv().
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// Fetch the user's argv array at uargv into argv, a page per string.
+// Returns 0, or -1 after freeing what was fetched.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[FAT32_MAX_PATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG * sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -41,18 +51,48 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
 
-  int ret = exec(path, argv);
+ bad:
+  freeargv(argv);
+  return -1;
+}
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+uint64
+sys_exec(void)
+{
+  char path[FAT32_MAX_PATH], *argv[MAXARG];
+  uint64 uargv;
 
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  int ret = exec(path, argv);
+
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Start path with argv as a new child; see spawn() in proc.c.
+uint64
+sys_spawn(void)
+{
+  char path[FAT32_MAX_PATH], *argv[MAXARG];
+  uint64 uargv;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  int pid = spawn(path, argv);
+
+  freeargv(argv);
+  return pid;
 }
 
 uint64
@@ -108,6 +148,56 @@ sys_sbrk(void)
   return addr;
 }
 
+// Find or create the shared-memory segment of a key.
+uint64
+sys_shmget(void)
+{
+  int key, flags;
+  uint64 size;
+
+  if(argint(0, &key) < 0 || argaddr(1, &size) < 0 || argint(2, &flags) < 0)
+    return -1;
+  return shmcreate(key, size, flags);
+}
+
+// Map a whole shared-memory segment, read-write, where mmap()
+// would put it. Returns its address.
+uint64
+sys_shmat(void)
+{
+  struct proc *p = myproc();
+  struct shm *s;
+  uint64 low, len;
+  int id;
+
+  if(argint(0, &id) < 0 || (s = shmattach(id)) == NULL)
+    return -1;
+  len = (uint64)s->npage * PGSIZE;
+  low = vmalowest(p->vma);
+  if(low - PGROUNDUP(p->sz) < len ||
+     vmaadd(&p->vma, low - len, low, NULL, 0, 0, PROT_READ | PROT_WRITE, MAP_SHARED) < 0){
+    shmput(s);
+    return -1;
+  }
+  p->vma->shm = s;
+  return low - len;
+}
+
+// Unmap the shared-memory segment attached at addr.
+uint64
+sys_shmdt(void)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  if((v = vmafind(p->vma, addr)) == NULL || v->shm == NULL || v->start != addr)
+    return -1;
+  return uvmmunmap(p, v->start, v->end - v->start);
+}
+
 uint64
 sys_sleep(void)
 {
@@ -12,6 +12,7 @@
 #include "include/console.h"
 #include "include/timer.h"
 #include "include/disk.h"
+#include "include/vm.h"
 
 extern char trampoline[], uservec[], userret[];
 
@@ -20,6 +21,18 @@ extern void kernelvec();
 
 int devintr();
 
+// scause of an access that faulted on its page's mapping.
+// The k210 implements the older privileged spec 1.9.1, which
+// may report these as access faults instead.
+#ifdef QEMU
+#define STORE_FAULT(c)  ((c) == 15)
+#define PAGE_FAULT(c)   ((c) == 12 || (c) == 13 || (c) == 15)
+#else
+#define STORE_FAULT(c)  ((c) == 15 || (c) == 7)
+#define PAGE_FAULT(c)   ((c) == 12 || (c) == 13 || (c) == 15 || \
+                         (c) == 1 || (c) == 5 || (c) == 7)
+#endif
+
 // void
 // trapinit(void)
 // {
@@ -35,6 +48,13 @@ trapinithart(void)
 {
   w_stvec((uint64)kernelvec);
   w_sstatus(r_sstatus() | SSTATUS_SIE);
+  // the kernel touches user memory directly, through
+  // the process page table (see copyin2())
+  #ifdef QEMU
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  #else
+  w_sstatus(r_sstatus() & ~SSTATUS_PUM);
+  #endif
   // enable supervisor-mode timer interrupts.
   w_sie(r_sie() | SIE_SEIE | SIE_SSIE | SIE_STIE);
   set_next_timeout();
@@ -80,6 +100,10 @@ usertrap(void)
   else if((which_dev = devintr()) != 0){
     // ok
   } 
+  else if(PAGE_FAULT(r_scause()) &&
+          uvmfault(p, r_stval(), STORE_FAULT(r_scause())) == 0){
+    // first touch of a program or heap page, or a write to a copy-on-write page
+  }
   else {
     printf("\nusertrap(): unexpected scause %p pid=%d %s\n", r_scause(), p->pid, p->name);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -132,9 +156,9 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  // printf("[usertrapret]p->pagetable: %p\n", p->pagetable);
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // tell trampoline.S the user page table to switch to: the one
+  // we are already on, with the process's ASID (see uvmswitch()).
+  uint64 satp = r_satp();
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -204,8 +228,8 @@ int devintr(void) {
 				consoleintr(c);
 			}
 		}
-		else if (DISK_IRQ == irq) {
-			disk_intr();
+		else if (disk_intr(irq)) {
+			// taken by a block driver
 		}
 		else if (irq) {
 			printf("unexpected interrupt irq = %d\n", irq);
@@ -4,6 +4,7 @@
 // qemu presents a "legacy" virtio interface.
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
+// more disks go on virtio-mmio-bus.1, .2, ...
 //
 
 
@@ -19,12 +20,15 @@
 #include "include/vm.h"
 #include "include/string.h"
 #include "include/printf.h"
+#include "include/timer.h"
+#include "include/disk.h"
+#include "include/plic.h"
 
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0_V + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)((d)->regs + (r)))
 
-static struct disk {
+struct disk {
  // memory for virtio descriptors &c for queue 0.
  // this is a global instead of allocated because it must
  // be multiple contiguous pages, which kalloc()
@@ -42,36 +46,69 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *busy;          // cleared, and woken up, when the device is done
+    int flushing;       // what busy points to for a flush, which has no buf
     char status;
   } info[NUM];
   
   struct spinlock vdisk_lock;
+  uint64 regs;            // base of this slot's mmio registers
+  int flush;              // device has a write cache, VIRTIO_BLK_F_FLUSH
+
+  // hybrid polling: after notifying the device, spin on the
+  // used ring for up to poll_spin time units before sleeping.
+  // 0 means plain interrupt-driven completion.
+  uint64 poll_spin;
+  int nsleep;             // requests sleeping for a completion interrupt
+  struct pollstat stat;
   
-} __attribute__ ((aligned (PGSIZE))) disk;
-
-void
-virtio_disk_init(void)
+} __attribute__ ((aligned (PGSIZE)));
+
+// one per attached disk, in probe order.
+static struct disk disks[NDISK];
+static int ndisks;
+
+static void virtio_disk_rw(struct blkdev *bd, struct buf *b, int write);
+static void virtio_disk_flush(struct blkdev *bd);
+static void virtio_disk_intr(struct blkdev *bd);
+static int virtio_disk_setpoll(struct blkdev *bd, int us);
+static void virtio_disk_pollstat(struct blkdev *bd, struct pollstat *st);
+
+static struct blkdev_ops virtio_ops = {
+  .rw = virtio_disk_rw,
+  .flush = virtio_disk_flush,
+  .intr = virtio_disk_intr,
+  .setpoll = virtio_disk_setpoll,
+  .pollstat = virtio_disk_pollstat,
+};
+
+// Set up the device behind mmio slot n as a block device.
+// Returns 0 if it is a usable disk, -1 if the slot holds something else.
+static int
+virtio_disk_attach(int n)
 {
+  struct disk *d = &disks[ndisks];
   uint32 status = 0;
-
-  initlock(&disk.vdisk_lock, "virtio_disk");
-
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 1 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  char name[BLKNAMESZ];
+
+  d->regs = VIRTIO_V(n);
+  if(*R(d, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(d, VIRTIO_MMIO_VERSION) != 1 ||
+     *R(d, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(d, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    return -1;
   }
+
+  initlock(&d->vdisk_lock, "virtio_disk");
   
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
@@ -79,41 +116,62 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  d->flush = (features >> VIRTIO_BLK_F_FLUSH) & 1;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
-  *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+  *R(d, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
+  uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+  *R(d, VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  memset(d->pages, 0, sizeof(d->pages));
+  *R(d, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)d->pages) >> PGSHIFT;
 
   // desc = pages -- num * VRingDesc
   // avail = pages + 0x40 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
-  disk.desc = (struct VRingDesc *) disk.pages;
-  disk.avail = (uint16*)(((char*)disk.desc) + NUM*sizeof(struct VRingDesc));
-  disk.used = (struct UsedArea *) (disk.pages + PGSIZE);
+  d->desc = (struct VRingDesc *) d->pages;
+  d->avail = (uint16*)(((char*)d->desc) + NUM*sizeof(struct VRingDesc));
+  d->used = (struct UsedArea *) (d->pages + PGSIZE);
 
   for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+    d->free[i] = 1;
+
+  // capacity is the first field of the device config space,
+  // a 64-bit count of 512-byte sectors.
+  uint64 capacity = *R(d, VIRTIO_MMIO_CONFIG) |
+                    (uint64)*R(d, VIRTIO_MMIO_CONFIG + 4) << 32;
+
+  // every request takes three descriptors.
+  safestrcpy(name, "virtio0", sizeof(name));
+  name[6] += n;
+  if(disk_register(name, &virtio_ops, d, capacity, NUM / 3, VIRTIO0_IRQ + n) < 0)
+    return -1;
+  ndisks++;
+  return 0;
+}
 
-  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+// Probe every virtio mmio slot and attach the disks found there.
+// plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ + slot.
+void
+virtio_disk_init(void)
+{
+  for(int n = 0; n < NVIRTIO && ndisks < NDISK; n++)
+    virtio_disk_attach(n);
   #ifdef DEBUG
   printf("virtio_disk_init\n");
   #endif
@@ -121,11 +179,11 @@ virtio_disk_init(void)
 
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
   for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
+    if(d->free[i]){
+      d->free[i] = 0;
       return i;
     }
   }
@@ -134,50 +192,132 @@ alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
   if(i >= NUM)
     panic("virtio_disk_intr 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("virtio_disk_intr 2");
-  disk.desc[i].addr = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->free[i] = 1;
+  wakeup(&d->free[0]);
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    free_desc(i);
-    if(disk.desc[i].flags & VRING_DESC_F_NEXT)
-      i = disk.desc[i].next;
+    free_desc(d, i);
+    if(d->desc[i].flags & VRING_DESC_F_NEXT)
+      i = d->desc[i].next;
     else
       break;
   }
 }
 
-static int
-alloc3_desc(int *idx)
+static void virtio_disk_reap(struct disk *d);
+
+// allocate n descriptors, sleeping until they are free.
+// caller holds d->vdisk_lock.
+static void
+alloc_descs(struct disk *d, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
+  while(1){
+    int i;
+    for(i = 0; i < n; i++){
+      idx[i] = alloc_desc(d);
+      if(idx[i] < 0)
+        break;
     }
+    if(i == n)
+      return;
+    for(int j = 0; j < i; j++)
+      free_desc(d, idx[j]);
+    sleep(&d->free[0], &d->vdisk_lock);
   }
-  return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// the header every block request starts with.
+struct virtio_blk_outhdr {
+  uint32 type;
+  uint32 reserved;
+  uint64 sector;
+};
+
+// Hand the chain starting at descriptor head to the device and
+// wait until it sets *busy to 0. Frees the chain.
+// Caller holds d->vdisk_lock.
+static void
+virtio_disk_submit(struct disk *d, int head, int *busy)
 {
+  d->info[head].status = 0;
+  d->info[head].busy = busy;
+  *busy = 1;
+
+  // avail[0] is flags
+  // avail[1] tells the device how far to look in avail[2...].
+  // avail[2...] are desc[] indices the device should process.
+  // we only tell device the first index in our chain of descriptors.
+
+  // in polling mode nobody needs the completion interrupt,
+  // unless someone is already asleep waiting for one.
+  if(d->poll_spin && d->nsleep == 0)
+    d->avail[0] = VRING_AVAIL_F_NO_INTERRUPT;
+  else
+    d->avail[0] = 0;
+  d->avail[2 + (d->avail[1] % NUM)] = head;
+  __sync_synchronize();
+  d->avail[1] = d->avail[1] + 1;
+
+  uint64 start = r_time();
+  int mode = (d->poll_spin != 0);
+
+  *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+
+  if(mode){
+    uint64 deadline = start + d->poll_spin;
+    while(1){
+      virtio_disk_reap(d);
+      if(*busy == 0 || r_time() >= deadline)
+        break;
+      // let the other hart submit or reap in between.
+      release(&d->vdisk_lock);
+      acquire(&d->vdisk_lock);
+    }
+    if(*busy == 0)
+      d->stat.hits++;
+    else
+      d->stat.misses++;
+  }
+
+  if(*busy){
+    // Going to sleep: make sure the device interrupts us, then look
+    // once more in case the request completed while the flag was set.
+    d->nsleep++;
+    d->avail[0] = 0;
+    __sync_synchronize();
+    virtio_disk_reap(d);
+    // Wait for virtio_disk_intr() to say request has finished.
+    while(*busy) {
+      sleep(busy, &d->vdisk_lock);
+    }
+    d->nsleep--;
+  }
+
+  lathist_add(&d->stat.lat[mode], TIME2US(r_time() - start));
+
+  d->info[head].busy = 0;
+  free_chain(d, head);
+}
+
+static void
+virtio_disk_rw(struct blkdev *bd, struct buf *b, int write)
+{
+  struct disk *d = bd->priv;
   uint64 sector = b->sectorno;
 
-  acquire(&disk.vdisk_lock);
+  acquire(&d->vdisk_lock);
 
   // the spec says that legacy block operations use three
   // descriptors: one for type/reserved/sector, one for
@@ -185,21 +325,12 @@ virtio_disk_rw(struct buf *b, int write)
 
   // allocate the three descriptors.
   int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  alloc_descs(d, idx, 3);
   
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr buf0;
 
   if(write)
     buf0.type = VIRTIO_BLK_T_OUT; // write the disk
@@ -210,68 +341,123 @@ virtio_disk_rw(struct buf *b, int write)
 
   // buf0 is on a kernel stack, which is not direct mapped,
   // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kwalkaddr(myproc()->kpagetable, (uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d->desc[idx[0]].addr = kvmpa((uint64) &buf0);
+  d->desc[idx[0]].len = sizeof(buf0);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
+  d->desc[idx[1]].addr = (uint64) b->data;
+  d->desc[idx[1]].len = BSIZE;
   if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+    d->desc[idx[1]].flags = 0; // device reads b->data
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+    d->desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+  d->desc[idx[1]].flags |= VRING_DESC_F_NEXT;
+  d->desc[idx[1]].next = idx[2];
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  d->desc[idx[2]].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[idx[2]].len = 1;
+  d->desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d->desc[idx[2]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // b->disk tells virtio_disk_reap() the device owns the buf.
+  virtio_disk_submit(d, idx[0], &b->disk);
 
-  // avail[0] is flags
-  // avail[1] tells the device how far to look in avail[2...].
-  // avail[2...] are desc[] indices the device should process.
-  // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
-  __sync_synchronize();
-  disk.avail[1] = disk.avail[1] + 1;
+  release(&d->vdisk_lock);
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// Ask the device to write its cache back. A flush carries no data,
+// just the header and the status byte.
+static void
+virtio_disk_flush(struct blkdev *bd)
+{
+  struct disk *d = bd->priv;
+  struct virtio_blk_outhdr buf0;
+  int idx[2];
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
+  // without VIRTIO_BLK_F_FLUSH completed writes are already durable.
+  if(!d->flush)
+    return;
+
+  acquire(&d->vdisk_lock);
+  alloc_descs(d, idx, 2);
+
+  buf0.type = VIRTIO_BLK_T_FLUSH;
+  buf0.reserved = 0;
+  buf0.sector = 0;
+
+  d->desc[idx[0]].addr = kvmpa((uint64) &buf0);
+  d->desc[idx[0]].len = sizeof(buf0);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
+
+  d->desc[idx[1]].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[idx[1]].len = 1;
+  d->desc[idx[1]].flags = VRING_DESC_F_WRITE;
+  d->desc[idx[1]].next = 0;
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  // the flag lives in info[], not on our stack, for
+  // virtio_disk_reap() to clear from any process or hart
+  virtio_disk_submit(d, idx[0], &d->info[idx[0]].flushing);
 
-  release(&disk.vdisk_lock);
+  release(&d->vdisk_lock);
 }
 
-void
-virtio_disk_intr()
+// Retire every request the device has put on the used ring.
+// Caller must hold d->vdisk_lock.
+static void
+virtio_disk_reap(struct disk *d)
 {
-  acquire(&disk.vdisk_lock);
-
-  while((disk.used_idx % NUM) != (disk.used->id % NUM)){
-    int id = disk.used->elems[disk.used_idx].id;
+  __sync_synchronize();
+  while((d->used_idx % NUM) != (d->used->id % NUM)){
+    int id = d->used->elems[d->used_idx].id;
 
-    if(disk.info[id].status != 0)
+    if(d->info[id].status != 0)
       panic("virtio_disk_intr status");
     
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+    *d->info[id].busy = 0;   // disk is done with the request
+    wakeup(d->info[id].busy);
 
-    disk.used_idx = (disk.used_idx + 1) % NUM;
+    d->used_idx = (d->used_idx + 1) % NUM;
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+}
+
+static void
+virtio_disk_intr(struct blkdev *bd)
+{
+  struct disk *d = bd->priv;
+
+  acquire(&d->vdisk_lock);
+
+  virtio_disk_reap(d);
+  *R(d, VIRTIO_MMIO_INTERRUPT_ACK) = *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  release(&d->vdisk_lock);
+}
+
+// Set the polling spin budget in microseconds, 0 turns polling off.
+// A negative value leaves it unchanged. Returns the previous budget.
+static int
+virtio_disk_setpoll(struct blkdev *bd, int us)
+{
+  struct disk *d = bd->priv;
+  int old;
+
+  acquire(&d->vdisk_lock);
+  old = TIME2US(d->poll_spin);
+  if(us >= 0)
+    d->poll_spin = US2TIME((uint64)us);
+  release(&d->vdisk_lock);
+  return old;
+}
+
+static void
+virtio_disk_pollstat(struct blkdev *bd, struct pollstat *st)
+{
+  struct disk *d = bd->priv;
 
-  release(&disk.vdisk_lock);
+  acquire(&d->vdisk_lock);
+  *st = d->stat;
+  st->spin = TIME2US(d->poll_spin);
+  release(&d->vdisk_lock);
 }
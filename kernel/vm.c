@@ -6,6 +6,12 @@
 #include "include/vm.h"
 #include "include/kalloc.h"
 #include "include/proc.h"
+#include "include/vma.h"
+#include "include/mman.h"
+#include "include/shm.h"
+#include "include/swap.h"
+#include "include/spinlock.h"
+#include "include/intr.h"
 #include "include/printf.h"
 #include "include/string.h"
 
@@ -15,6 +21,7 @@
 pagetable_t kernel_pagetable;
 
 extern char etext[];  // kernel.ld sets this to end of kernel code.
+static pte_t *walklevel(pagetable_t pagetable, uint64 va, int alloc, int *level);
 extern char trampoline[]; // trampoline.S
 /*
  * create a direct-map page table for the kernel.
@@ -22,17 +29,15 @@ extern char trampoline[]; // trampoline.S
 void
 kvminit()
 {
-  kernel_pagetable = (pagetable_t) kalloc();
+  kernel_pagetable = (pagetable_t) kzalloc();
   // printf("kernel_pagetable: %p\n", kernel_pagetable);
 
-  memset(kernel_pagetable, 0, PGSIZE);
-
   // uart registers
   kvmmap(UART_V, UART, PGSIZE, PTE_R | PTE_W);
   
   #ifdef QEMU
   // virtio mmio disk interface
-  kvmmap(VIRTIO0_V, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+  kvmmap(VIRTIO0_V, VIRTIO0, NVIRTIO * PGSIZE, PTE_R | PTE_W);
   #endif
   // CLINT
   kvmmap(CLINT_V, CLINT, 0x10000, PTE_R | PTE_W);
@@ -99,6 +104,91 @@ kvminithart()
   #endif
 }
 
+// Address space IDs let each process keep its TLB entries across
+// context switches. ASIDs are handed out in generations: when one
+// runs out, the generation moves on, each process takes a fresh
+// ASID the next time it is scheduled, and each hart flushes its
+// whole TLB once before using the new generation.
+// p->asid keeps the generation above the ASID itself.
+#define ASIDGEN(asid)   ((asid) >> 16)
+#define ASIDNUM(asid)   ((asid) & SATP_ASID_MASK)
+
+static struct {
+  struct spinlock lock;
+  int bits;       // ASID bits the hardware has, 0 for none
+  uint64 gen;     // current generation
+  uint64 next;    // next unused ASID of this generation
+} asids;
+
+// Find out how many ASID bits satp keeps. Call on hart 0
+// with paging on.
+void
+asidinit(void)
+{
+  initlock(&asids.lock, "asid");
+  #ifdef QEMU
+  uint64 satp = r_satp();
+  w_satp(satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+  for(uint64 a = SATP_ASID(r_satp()); a & 1; a >>= 1)
+    asids.bits++;
+  w_satp(satp);
+  #endif
+  asids.gen = 1;
+  asids.next = 1;   // 0 belongs to kernel_pagetable
+  #ifdef DEBUG
+  printf("asidinit: %d ASID bits\n", asids.bits);
+  #endif
+}
+
+// Switch this hart to p's page table. With ASIDs, only a hart
+// that hasn't seen the current generation, or that p has not
+// run on last, needs to flush anything; without, flush it all.
+void
+uvmswitch(struct proc *p)
+{
+  int id, flushall = 0;
+
+  push_off();
+  if(asids.bits == 0){
+    w_satp(MAKE_SATP(p->pagetable));
+    sfence_vma();
+    pop_off();
+    return;
+  }
+  id = cpuid();
+  acquire(&asids.lock);
+  if(ASIDGEN(p->asid) != asids.gen){
+    if(asids.next == (1L << asids.bits)){
+      asids.gen++;
+      asids.next = 1;
+    }
+    p->asid = (asids.gen << 16) | asids.next++;
+  }
+  if(mycpu()->asidgen != asids.gen){
+    mycpu()->asidgen = asids.gen;
+    flushall = 1;
+  }
+  release(&asids.lock);
+
+  w_satp(MAKE_SATP_ASID(p->pagetable, ASIDNUM(p->asid)));
+  if(flushall)
+    sfence_vma();
+  else if(p->lastcpu != id)
+    sfence_vma_asid(ASIDNUM(p->asid));
+  p->lastcpu = id;
+  pop_off();
+}
+
+// Back to the kernel page table, e.g. in the scheduler, so that
+// the last process's page table can be freed under us.
+void
+kvmswitch(void)
+{
+  w_satp(MAKE_SATP(kernel_pagetable));
+  if(asids.bits == 0)
+    sfence_vma();
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -111,25 +201,40 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// Walking stops early at a leaf in an upper level, i.e. a
+// superpage of the kernel's (see mappages()), and returns that.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
-  
+  int level = 0;
+
+  return walklevel(pagetable, va, alloc, &level);
+}
+
+// walk() down to the PTE at *level, or to a leaf above it, and
+// set *level to the level of the PTE returned.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int *level)
+{
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > *level; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte)){
+        *level = l;
+        return pte;
+      }
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == NULL)
+      if(!alloc || (pagetable = (pde_t*)kzalloc()) == NULL)
         return NULL;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(*level, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -155,6 +260,36 @@ walkaddr(pagetable_t pagetable, uint64 va)
   return pa;
 }
 
+// Find the first PTE at or above *va, below MAXUVA, that maps a
+// user page, skipping the stretches without page-table pages.
+// Returns it, with its address in *va, or 0 if there is none.
+pte_t *
+uvmnext(pagetable_t pagetable, uint64 *va)
+{
+  uint64 a = PGROUNDDOWN(*va);
+  pte_t *pte;
+  int level;
+
+  while(a < MAXUVA){
+    level = 0;
+    pte = walklevel(pagetable, a, 0, &level);
+    if(pte == NULL){
+      // no page-table page below level 2 or 1 at a: nothing
+      // is mapped up to the end of the stretch it would cover
+      pte = &pagetable[PX(2, a)];
+      level = (*pte & PTE_V) ? 1 : 2;
+      a = (a | ((1L << PXSHIFT(level)) - 1)) + 1;
+      continue;
+    }
+    if(level == 0 && (*pte & (PTE_V|PTE_U)) == (PTE_V|PTE_U)){
+      *va = a;
+      return pte;
+    }
+    a += PGSIZE;
+  }
+  return NULL;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -168,27 +303,20 @@ kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 // translate a kernel virtual address to
 // a physical address. only needed for
 // addresses on the stack.
-// assumes va is page aligned.
 uint64
 kvmpa(uint64 va)
 {
-  return kwalkaddr(kernel_pagetable, va);
-}
-
-uint64
-kwalkaddr(pagetable_t kpt, uint64 va)
-{
-  uint64 off = va % PGSIZE;
+  int level = 0;
   pte_t *pte;
   uint64 pa;
   
-  pte = walk(kpt, va, 0);
+  pte = walklevel(kernel_pagetable, va, 0, &level);
   if(pte == 0)
     panic("kvmpa");
   if((*pte & PTE_V) == 0)
     panic("kvmpa");
   pa = PTE2PA(*pte);
-  return pa+off;
+  return pa + va % (1L << PXSHIFT(level));
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -198,63 +326,103 @@ kwalkaddr(pagetable_t kpt, uint64 va)
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, last, step;
   pte_t *pte;
+  int level;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == NULL)
+    // Kernel mappings take a 2 MB superpage wherever va, pa and
+    // size line up, saving page-table pages and TLB entries. User
+    // memory stays in 4 KB pages, faulted in, shared copy-on-write
+    // and unmapped one at a time.
+    if((perm & PTE_U) == 0 && a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       last - a >= SUPERPGSIZE - PGSIZE){
+      level = 1;
+      step = SUPERPGSIZE;
+    } else {
+      level = 0;
+      step = PGSIZE;
+    }
+    if((pte = walklevel(pagetable, a, 1, &level)) == NULL)
       return -1;
     if(*pte & PTE_V)
       panic("remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
+    if(last - a < step)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += step;
+    pa += step;
   }
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that aren't mapped are skipped.
 // Optionally free the physical memory.
 void
 vmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, pa;
   pte_t *pte;
+  int live;
 
   if((va % PGSIZE) != 0)
     panic("vmunmap: not aligned");
 
+  // only the page table this hart runs on can have TLB entries
+  // worth flushing; dead ones' ASIDs are never reused in this
+  // generation.
+  live = MAKE_SATP(pagetable) == (r_satp() & ~(SATP_ASID_MASK << SATP_ASID_SHIFT));
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    // user heap pages are only mapped once touched
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("vmunmap: walk");
+      continue;
+    if(*pte & PTE_SWAP){
+      if(do_free)
+        swapfree(PTE2SLOT(*pte));
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("vmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("vmunmap: not a leaf");
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
-    }
+    pa = PTE2PA(*pte);
     *pte = 0;
+    if(live)
+      sfence_vma_va(a);
+    if(do_free)
+      kfree((void*)pa);
   }
 }
 
-// create an empty user page table.
+// The kernel is mapped into every user page table by sharing the
+// kernel page table's top-level entries above user space, so the
+// kernel runs on the process's page table and reaches user memory
+// directly (with sstatus.SUM set). The trampoline's entry is left
+// out: each process maps its own trapframe next to the trampoline.
+static int
+kvmshared(int i)
+{
+  return i >= PX(2, MAXUVA) && i != PX(2, TRAMPOLINE);
+}
+
+// create a user page table with no user memory,
+// but with the kernel mapped.
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kzalloc();
   if(pagetable == NULL)
     return NULL;
-  memset(pagetable, 0, PGSIZE);
+  for(int i = 0; i < 512; i++)
+    if(kvmshared(i))
+      pagetable[i] = kernel_pagetable[i];
   return pagetable;
 }
 
@@ -262,27 +430,40 @@ uvmcreate()
 // for the very first process.
 // sz must be less than a page.
 void
-uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
+uvminit(pagetable_t pagetable, uchar *src, uint sz)
 {
   char *mem;
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
+  mem = kzalloc();
   // printf("[uvminit]kalloc: %p\n", mem);
-  memset(mem, 0, PGSIZE);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
-  mappages(kpagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X);
   memmove(mem, src, sz);
   // for (int i = 0; i < sz; i ++) {
   //   printf("[uvminit]mem: %p, %x\n", mem + i, mem[i]);
   // }
 }
 
+// A page for user memory, zeroed if zero is set. When there is
+// no free memory, cold pages are paged out until there is.
+// Returns 0 if that doesn't help either. May sleep.
+static void*
+uvmkalloc(int zero)
+{
+  void *mem;
+
+  while((mem = zero ? kzalloc() : kalloc()) == NULL){
+    if(swapout() < 0)
+      return NULL;
+  }
+  return mem;
+}
+
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 uint64
-uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
   uint64 a;
@@ -292,21 +473,14 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = uvmkalloc(1);
     if(mem == NULL){
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
+      uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0) {
       kfree(mem);
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
-      return 0;
-    }
-    if (mappages(kpagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R) != 0){
-      int npages = (a - oldsz) / PGSIZE;
-      vmunmap(pagetable, oldsz, npages + 1, 1);   // plus the page allocated above.
-      vmunmap(kpagetable, oldsz, npages, 0);
+      uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
   }
@@ -318,14 +492,13 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
 uint64
-uvmdealloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   if(newsz >= oldsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    vmunmap(kpagetable, PGROUNDUP(newsz), npages, 0);
     vmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
@@ -359,51 +532,250 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 {
   if(sz > 0)
     vmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+  for(int i = 0; i < 512; i++)
+    if(kvmshared(i))
+      pagetable[i] = 0;       // the kernel's, not ours to free
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Writable pages become read-only copy-on-write
+// pages in both; the first write copies them
+// (see uvmcow()).
+// Copies [start, end), which must be page-aligned.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
 {
-  pte_t *pte;
-  uint64 pa, i = 0, ki = 0;
+  pte_t *pte, *npte;
+  uint64 pa, i = start;
   uint flags;
-  char *mem;
 
-  while (i < sz){
-    if((pte = walk(old, i, 0)) == NULL)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+  while (i < end){
+    if((pte = walk(old, i, 0)) == NULL || (*pte & (PTE_V|PTE_SWAP)) == 0){
+      i += PGSIZE;              // not touched yet, stays lazy in the child
+      continue;
+    }
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    if(*pte & PTE_SWAP){
+      // paged out: share the slot, each reads its own copy back
+      if((npte = walk(new, i, 1)) == NULL)
+        goto err;
+      *npte = *pte;
+      swapdup(PTE2SLOT(*pte));
+      i += PGSIZE;
+      continue;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == NULL)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0) {
-      kfree(mem);
-      goto err;
-    }
+    krefinc((void*)pa);
     i += PGSIZE;
-    if(mappages(knew, ki, PGSIZE, (uint64)mem, flags & ~PTE_U) != 0){
-      goto err;
-    }
-    ki += PGSIZE;
   }
+  // the parent's pages just lost PTE_W
+  sfence_vma_asid(SATP_ASID(r_satp()));
   return 0;
 
  err:
-  vmunmap(knew, 0, ki / PGSIZE, 0);
-  vmunmap(new, 0, i / PGSIZE, 1);
+  vmunmap(new, start, (i - start) / PGSIZE, 1);
+  sfence_vma_asid(SATP_ASID(r_satp()));
   return -1;
 }
 
+// Give the process a private, writable copy of the
+// copy-on-write page at va, or just make it writable
+// if nobody else shares it any more.
+// returns 0 on success, -1 if va isn't a copy-on-write
+// page or there is no memory for the copy.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa, old;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte == NULL || (*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+
+  pa = old = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) | PTE_W | PTE_D) & ~PTE_COW;
+  if(krefcnt((void*)pa) > 1){
+    // the other sharers may go while uvmkalloc() pages things
+    // out; our own reference keeps swapout() off the page
+    krefinc((void*)old);
+    if((mem = uvmkalloc(0)) != NULL)
+      pagecopy(mem, (char*)old);
+    kfree((void*)old);
+    if(mem == NULL)
+      return -1;
+    pa = (uint64)mem;
+  }
+  *pte = PA2PTE(pa) | flags;
+  sfence_vma_va(va);
+  if(pa != old)
+    kfree((void*)old);
+  return 0;
+}
+
+// Handle a fault on user address va of process p; write is
+// nonzero for a store. Maps the page from its file if it lies
+// in one of p's vmas, or a zeroed page where the heap hasn't
+// been touched yet, or breaks copy-on-write sharing.
+// returns 0 if the access can be retried, -1 if it is an error
+// or there is no memory left.
+int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  int perm = PTE_W|PTE_X|PTE_R|PTE_U;
+
+  v = vmafind(p->vma, va);
+  if(va >= p->sz && (v == NULL || v->flags == 0))
+    return -1;
+  if(v && v->flags){
+    if((write && (v->prot & PROT_WRITE) == 0) || v->prot == PROT_NONE)
+      return -1;
+    perm = PTE_U;
+    if(v->prot & PROT_READ)
+      perm |= PTE_R;
+    if(v->prot & PROT_WRITE)
+      perm |= PTE_R|PTE_W;
+    if(v->prot & PROT_EXEC)
+      perm |= PTE_X;
+    // pages of shared file mappings start out read-only, so
+    // that the first store marks them dirty for uvmmunmap()
+    if((v->flags & MAP_SHARED) && v->ep)
+      perm = write ? perm | PTE_D : perm & ~PTE_W;
+  }
+  va = PGROUNDDOWN(va);
+  pte = walk(p->pagetable, va, 0);
+  if(pte && (*pte & PTE_SWAP)){
+    // the page table page stays, and only we change our PTEs
+    if((mem = uvmkalloc(0)) == NULL)
+      return -1;
+    if(swapin(PTE2SLOT(*pte), mem) < 0){
+      kfree(mem);
+      return -1;
+    }
+    *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_V | PTE_A;
+    sfence_vma_va(va);
+    if(!write || (*pte & PTE_W))
+      return 0;
+  }
+  if(pte && (*pte & PTE_V)){
+    if(write && (*pte & PTE_COW))
+      return uvmcow(p->pagetable, va);
+    if(write && (perm & PTE_W) && (*pte & PTE_W) == 0){
+      *pte |= PTE_W|PTE_D;
+      sfence_vma_va(va);
+      return 0;
+    }
+    // a hart that leaves PTE_A and PTE_D to software faults
+    // on pages whose PTE_A swapout() cleared
+    if((*pte & PTE_U) == 0 || (write && (*pte & PTE_W) == 0))
+      return -1;
+    if((*pte & PTE_A) == 0 || (write && (*pte & PTE_D) == 0)){
+      *pte |= write ? PTE_A|PTE_D : PTE_A;
+      sfence_vma_va(va);
+      return 0;
+    }
+    return -1;
+  }
+
+  if(v && v->shm){
+    if((mem = shmpage(v->shm, (v->off + va - v->start) / PGSIZE)) == NULL)
+      return -1;
+  } else if(v && (write == 0 || (v->flags & MAP_SHARED)) && (mem = vmapage(v, va)) != NULL){
+    // the file's cached page itself: shared mappings store into
+    // it, anything else gets a copy on the first store
+    if((v->flags & MAP_SHARED) == 0 && (perm & PTE_W))
+      perm = (perm & ~PTE_W) | PTE_COW;
+  } else if(v && (v->flags & MAP_SHARED) && v->ep && va - v->start < v->filesz){
+    // no cached page, for want of memory or a failed read: a
+    // private copy would split this mapping from the file's
+    // other users, fork()ed children included
+    return -1;
+  } else if(v && va - v->start < v->filesz){
+    if((mem = uvmkalloc(0)) == NULL)
+      return -1;
+    if(vmafill(v, va, mem) < 0){
+      kfree(mem);
+      return -1;
+    }
+  } else if((mem = uvmkalloc(1)) == NULL)
+    return -1;
+  // a page-table page may have to be made room for, too
+  while(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    if(swapout() < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  // the TLB may have cached the invalid entry
+  sfence_vma_va(va);
+  return 0;
+}
+
+// Unmap [va, va+len) of p's mmap() regions, writing the dirty
+// pages of shared file mappings back first. va and len must be
+// page-aligned. May sleep.
+// Returns 0, or -1 if out of memory to split a region.
+int
+uvmmunmap(struct proc *p, uint64 va, uint64 len)
+{
+  struct vma *v;
+  uint64 a, start, end;
+  pte_t *pte;
+
+  for(v = p->vma; v; v = v->next){
+    if(v->flags == 0)
+      continue;
+    start = v->start > va ? v->start : va;
+    end = v->end < va + len ? v->end : va + len;
+    for(a = start; a < end; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == NULL || (*pte & (PTE_V|PTE_SWAP)) == 0)
+        continue;
+      // like close(), there is no one to report a failed write to
+      if((v->flags & MAP_SHARED) && v->ep && (*pte & (PTE_V|PTE_D)) == (PTE_V|PTE_D))
+        vmawrite(v, a, (char*)PTE2PA(*pte));
+      vmunmap(p->pagetable, a, 1, 1);
+    }
+  }
+  return vmaremove(&p->vma, va, va + len);
+}
+
+// Fault in the user pages covering [va, va+len), so that the
+// kernel can access them directly; write as for uvmfault().
+// The caller holds p->pin until it is done with them, which
+// keeps swapout() away from them.
+static int
+uvmtouch(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  uint64 a;
+  pte_t *pte;
+
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte && (*pte & (PTE_V|PTE_A)) == (PTE_V|PTE_A) && (write == 0 || (*pte & PTE_W)))
+      continue;
+    if(uvmfault(p, a, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -442,14 +814,58 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
   return 0;
 }
 
+// The end of the part of p's address space holding va: sz if va
+// is below it, else the end of the mmap() or shmat() region it is
+// in; 0 if neither. A user buffer must lie within one such part;
+// uvmtouch() then checks the protection page by page.
+static uint64
+uvmend(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  if(va < p->sz)
+    return p->sz;
+  if((v = vmafind(p->vma, va)) != NULL && v->flags)
+    return v->end;
+  return 0;
+}
+
+// Check that the user buffer [va, va+len) lies within one part
+// of the address space, fault it in, write as for uvmfault(), and
+// pin it there until uvmunpin(). Returns 0, or -1 if the buffer
+// is bad. Callers that access the buffer while holding a file's
+// lock pin it first: faulting a file-backed page takes that
+// file's lock, which could be held by a process faulting on ours.
+int
+uvmpin(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  uint64 end = uvmend(p, va);
+
+  if(va + len > end || va + len < va)
+    return -1;
+  p->pin++;
+  if(uvmtouch(va, len, write) < 0){
+    p->pin--;
+    return -1;
+  }
+  return 0;
+}
+
+void
+uvmunpin(void)
+{
+  myproc()->pin--;
+}
+
 int
 copyout2(uint64 dstva, char *src, uint64 len)
 {
-  uint64 sz = myproc()->sz;
-  if (dstva + len > sz || dstva >= sz) {
+  if (uvmpin(dstva, len, 1) < 0) {
     return -1;
   }
   memmove((void *)dstva, src, len);
+  uvmunpin();
   return 0;
 }
 
@@ -481,11 +897,11 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyin2(char *dst, uint64 srcva, uint64 len)
 {
-  uint64 sz = myproc()->sz;
-  if (srcva + len > sz || srcva >= sz) {
+  if (uvmpin(srcva, len, 0) < 0) {
     return -1;
   }
   memmove(dst, (void *)srcva, len);
+  uvmunpin();
   return 0;
 }
 
@@ -536,8 +952,13 @@ int
 copyinstr2(char *dst, uint64 srcva, uint64 max)
 {
   int got_null = 0;
-  uint64 sz = myproc()->sz;
-  while(srcva < sz && max > 0){
+  struct proc *pr = myproc();
+  uint64 end = uvmend(pr, srcva);
+  uint64 start = srcva;
+  pr->pin++;
+  while(srcva < end && max > 0){
+    if((srcva == start || srcva % PGSIZE == 0) && uvmtouch(srcva, 1, 0) < 0)
+      break;
     char *p = (char *)srcva;
     if(*p == '\0'){
       *dst = '\0';
@@ -550,6 +971,7 @@ copyinstr2(char *dst, uint64 srcva, uint64 max)
     srcva++;
     dst++;
   }
+  pr->pin--;
   if(got_null){
     return 0;
   } else {
@@ -557,72 +979,6 @@ copyinstr2(char *dst, uint64 srcva, uint64 max)
   }
 }
 
-// initialize kernel pagetable for each process.
-pagetable_t
-proc_kpagetable()
-{
-  pagetable_t kpt = (pagetable_t) kalloc();
-  if (kpt == NULL)
-    return NULL;
-  memmove(kpt, kernel_pagetable, PGSIZE);
-
-  // remap stack and trampoline, because they share the same page table of level 1 and 0
-  char *pstack = kalloc();
-  if(pstack == NULL)
-    goto fail;
-  if (mappages(kpt, VKSTACK, PGSIZE, (uint64)pstack, PTE_R | PTE_W) != 0)
-    goto fail;
-  
-  return kpt;
-
-fail:
-  kvmfree(kpt, 1);
-  return NULL;
-}
-
-// only free page table, not physical pages
-void
-kfreewalk(pagetable_t kpt)
-{
-  for (int i = 0; i < 512; i++) {
-    pte_t pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    } else if (pte & PTE_V) {
-      break;
-    }
-  }
-  kfree((void *) kpt);
-}
-
-void
-kvmfreeusr(pagetable_t kpt)
-{
-  pte_t pte;
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    }
-  }
-}
-
-void
-kvmfree(pagetable_t kpt, int stack_free)
-{
-  if (stack_free) {
-    vmunmap(kpt, VKSTACK, 1, 1);
-    pte_t pte = kpt[PX(2, VKSTACK)];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-    }
-  }
-  kvmfreeusr(kpt);
-  kfree(kpt);
-}
-
 void vmprint(pagetable_t pagetable)
 {
   const int capacity = 512;
@@ -632,12 +988,16 @@ void vmprint(pagetable_t pagetable)
     {
       pagetable_t pt2 = (pagetable_t) PTE2PA(*pte); 
       printf("..%d: pte %p pa %p\n", pte - pagetable, *pte, pt2);
+      if (PTE_LEAF(*pte))
+        continue;
 
       for (pte_t *pte2 = (pte_t *) pt2; pte2 < pt2 + capacity; pte2++) {
         if (*pte2 & PTE_V)
         {
           pagetable_t pt3 = (pagetable_t) PTE2PA(*pte2);
-          printf(".. ..%d: pte %p pa %p\n", pte2 - pt2, *pte2, pt3);
+          printf(".. ..%d: pte %p pa %p%s\n", pte2 - pt2, *pte2, pt3, PTE_LEAF(*pte2) ? " (2 MB)" : "");
+          if (PTE_LEAF(*pte2))
+            continue;
 
           for (pte_t *pte3 = (pte_t *) pt3; pte3 < pt3 + capacity; pte3++)
             if (*pte3 & PTE_V)
@@ -0,0 +1,251 @@
+// File-backed regions of user address spaces.
+//
+// exec() records each loadable segment as a vma instead of reading
+// it in, and uvmfault() fills a page of the segment from the file
+// the first time the process touches it. mmap() regions are vmas
+// too, anonymous ones simply having no file.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/memlayout.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/fat32.h"
+#include "include/kmalloc.h"
+#include "include/vma.h"
+#include "include/mman.h"
+#include "include/pcache.h"
+#include "include/shm.h"
+#include "include/kalloc.h"
+#include "include/string.h"
+
+// Add [start, end) backed by filesz bytes of ep from offset off
+// to list. Returns 0, or -1 if out of memory.
+int
+vmaadd(struct vma **list, uint64 start, uint64 end, struct dirent *ep, uint64 off, uint64 filesz,
+       int prot, int flags)
+{
+  struct vma *v;
+
+  if((v = kmalloc(sizeof(struct vma))) == NULL)
+    return -1;
+  v->start = start;
+  v->end = end;
+  v->ep = ep ? edup(ep) : NULL;
+  v->off = off;
+  v->filesz = filesz;
+  v->prot = prot;
+  v->flags = flags;
+  v->shm = NULL;
+  v->next = *list;
+  *list = v;
+  return 0;
+}
+
+// The region of list containing va, or 0.
+struct vma*
+vmafind(struct vma *list, uint64 va)
+{
+  for(; list; list = list->next){
+    if(va >= list->start && va < list->end)
+      return list;
+  }
+  return NULL;
+}
+
+// Copy the regions of src onto dst, for fork().
+// Returns 0, or -1 if out of memory.
+int
+vmadup(struct vma **dst, struct vma *src)
+{
+  for(; src; src = src->next){
+    if(vmaadd(dst, src->start, src->end, src->ep, src->off, src->filesz,
+              src->prot, src->flags) < 0)
+      return -1;
+    if(((*dst)->shm = src->shm) != NULL)
+      shmdup(src->shm);
+  }
+  return 0;
+}
+
+static void
+vmadrop(struct vma *v)
+{
+  if(v->ep)
+    eput(v->ep);
+  if(v->shm)
+    shmput(v->shm);
+  kmfree(v);
+}
+
+// Cut the exec() segments of list down to an address space of sz
+// bytes, so that pages past sz come back as zero if it grows again.
+void
+vmatrim(struct vma **list, uint64 sz)
+{
+  struct vma *v;
+
+  while((v = *list) != NULL){
+    if(v->flags == 0 && v->start >= sz){
+      *list = v->next;
+      vmadrop(v);
+      continue;
+    }
+    if(v->flags == 0 && v->end > sz)
+      v->end = sz;
+    if(v->flags == 0 && v->start + v->filesz > sz)
+      v->filesz = sz - v->start;
+    list = &v->next;
+  }
+}
+
+// Drop all regions of list. May sleep, so the caller must not
+// hold a spinlock.
+void
+vmafree(struct vma **list)
+{
+  struct vma *v;
+
+  while((v = *list) != NULL){
+    *list = v->next;
+    vmadrop(v);
+  }
+}
+
+// Take [start, end) out of the mmap() regions of list, splitting
+// a region that it falls in the middle of. May sleep.
+// Returns 0, or -1 if out of memory for a split.
+int
+vmaremove(struct vma **list, uint64 start, uint64 end)
+{
+  struct vma *v;
+  uint64 cut;
+
+  while((v = *list) != NULL){
+    if(v->flags == 0 || v->end <= start || v->start >= end){
+      list = &v->next;
+      continue;
+    }
+    if(v->start >= start && v->end <= end){
+      *list = v->next;
+      vmadrop(v);
+      continue;
+    }
+    if(v->start < start && v->end > end){
+      cut = end - v->start;
+      if(vmaadd(&v->next, end, v->end, v->ep, v->off + cut,
+                v->filesz > cut ? v->filesz - cut : 0, v->prot, v->flags) < 0)
+        return -1;
+      if((v->next->shm = v->shm) != NULL)
+        shmdup(v->shm);
+    }
+    if(v->start < start){
+      // keep the head
+      v->end = start;
+      if(v->filesz > start - v->start)
+        v->filesz = start - v->start;
+    } else {
+      // keep the tail
+      cut = end - v->start;
+      v->start = end;
+      v->off += cut;
+      v->filesz = v->filesz > cut ? v->filesz - cut : 0;
+    }
+    list = &v->next;
+  }
+  return 0;
+}
+
+// Lowest address of the mmap() regions of list, or MAXUVA if
+// there are none; the heap can't grow past it.
+uint64
+vmalowest(struct vma *list)
+{
+  uint64 low = MAXUVA;
+
+  for(; list; list = list->next){
+    if(list->flags && list->start < low)
+      low = list->start;
+  }
+  return low;
+}
+
+// The page cache's page for va of v, with a page reference for
+// the caller to map it by; otherwise 0, and the caller fills a
+// page with vmafill(). A private mapping only gets a page its
+// file data covers all of, since what follows in the page must
+// read as zeros (an exec segment's bss, say). A shared one gets
+// any page holding file data, the last partial page too: that
+// is where read() and write() see its stores, and the cache
+// keeps the part past the end of the file out of it.
+char*
+vmapage(struct vma *v, uint64 va)
+{
+  uint64 off = va - v->start;
+  struct cpage *pg;
+  char *mem = NULL;
+
+  if(v->ep == NULL || off >= v->filesz || (v->off + off) % PGSIZE != 0)
+    return NULL;
+  if((v->flags & MAP_SHARED) == 0 && off + PGSIZE > v->filesz)
+    return NULL;
+  elock(v->ep);
+  if((pg = pcget(v->ep, (v->off + off) / PGSIZE, 1)) != NULL){
+    mem = pg->data;
+    krefinc(mem);
+    pcput(pg, 0);
+  }
+  eunlock(v->ep);
+  return mem;
+}
+
+// Fill mem with the page at va of v: the file's bytes, then zeros.
+// Returns 0, or -1 if the file can't be read.
+int
+vmafill(struct vma *v, uint64 va, char *mem)
+{
+  uint64 off = va - v->start;
+  uint n = 0;
+  int r;
+
+  if(off < v->filesz){
+    n = v->filesz - off < PGSIZE ? v->filesz - off : PGSIZE;
+    elock(v->ep);
+    r = eread(v->ep, 0, (uint64)mem, v->off + off, n);
+    eunlock(v->ep);
+    if(r != n)
+      return -1;
+  }
+  if(n < PGSIZE)
+    memset(mem + n, 0, PGSIZE - n);
+  return 0;
+}
+
+// Write the file's part of the page at va of v back from mem,
+// for a dirty page of a MAP_SHARED region. The file may have
+// been truncated since mmap(), so only what it still holds is
+// written; the page must not grow it back.
+// Returns 0, or -1 if the file can't be written.
+int
+vmawrite(struct vma *v, uint64 va, char *mem)
+{
+  uint64 off = va - v->start;
+  uint64 foff = v->off + off;
+  uint n;
+  int r;
+
+  if(off >= v->filesz)
+    return 0;
+  n = v->filesz - off < PGSIZE ? v->filesz - off : PGSIZE;
+  elock(v->ep);
+  if(foff >= v->ep->file_size){
+    eunlock(v->ep);
+    return 0;
+  }
+  if(n > v->ep->file_size - foff)
+    n = v->ep->file_size - foff;
+  r = ewrite(v->ep, 0, (uint64)mem, foff, n);
+  eunlock(v->ep);
+  return r == n ? 0 : -1;
+}
@@ -0,0 +1,47 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/iostat.h"
+#include "xv6-user/user.h"
+
+static void
+printlat(char *mode, struct lathist *h)
+{
+  uint64 avg = h->count ? h->total / h->count : 0;
+  printf("%s\treqs %l\tavg %l us\tp50 < %l us\tp99 < %l us\n",
+         mode, h->count, avg, percentile(h, 50), percentile(h, 99));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pollstat st;
+
+  if(argc >= 2 && strcmp(argv[1], "on") == 0){
+    int us = argc >= 3 ? atoi(argv[2]) : 50;
+    if(us <= 0 || blkctl(0, BLK_POLL, us) < 0){
+      fprintf(2, "diskpoll: cannot enable polling\n");
+      exit(1);
+    }
+  } else if(argc >= 2 && strcmp(argv[1], "off") == 0){
+    if(blkctl(0, BLK_POLL, 0) < 0){
+      fprintf(2, "diskpoll: cannot disable polling\n");
+      exit(1);
+    }
+  } else if(argc >= 2 && strcmp(argv[1], "stat") != 0){
+    fprintf(2, "usage: diskpoll [on [us] | off | stat]\n");
+    exit(1);
+  }
+
+  if(blkctl(0, BLK_POLLSTAT, (uint64)&st) < 0){
+    fprintf(2, "diskpoll: no polling support on this disk\n");
+    exit(1);
+  }
+  if(st.spin)
+    printf("mode: hybrid polling, spin %l us\n", st.spin);
+  else
+    printf("mode: interrupt\n");
+  printf("poll hits %l, misses %l\n", st.hits, st.misses);
+  printlat("intr", &st.lat[0]);
+  printlat("poll", &st.lat[1]);
+  exit(0);
+}
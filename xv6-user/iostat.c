@@ -0,0 +1,64 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/iostat.h"
+#include "xv6-user/user.h"
+
+static void
+printhist(char *dir, struct lathist *h)
+{
+  uint64 avg = h->count ? h->total / h->count : 0;
+
+  printf("  %s\treqs %l\tavg %l us\tp50 < %l us\tp99 < %l us\n",
+         dir, h->count, avg, percentile(h, 50), percentile(h, 99));
+  if(h->count == 0)
+    return;
+  for(int i = 0; i < NLATBKT; i++){
+    if(h->bkt[i] == 0)
+      continue;
+    printf("    < %l us\t%l\n", 2UL << i, h->bkt[i]);
+  }
+}
+
+static int
+show(int dev, int verbose)
+{
+  struct iostat st;
+  struct blkinfo info;
+
+  if(blkctl(dev, BLK_INFO, (uint64)&info) < 0 || blkctl(dev, BLK_STAT, (uint64)&st) < 0)
+    return -1;
+  printf("disk%d (%s): reads %l (%l sectors)  writes %l (%l sectors)\n",
+         dev, info.name, st.reads, st.rsectors, st.writes, st.wsectors);
+  printf("  cached %l  merges %l  flushes %l  in-flight %l  busy %l ms\n",
+         st.cached, st.merges, st.flushes, st.in_flight, st.busy / 1000);
+  if(verbose){
+    printhist("read", &st.lat[0]);
+    printhist("write", &st.lat[1]);
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int verbose = 0;
+  int dev = -1;
+
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-v") == 0)
+      verbose = 1;
+    else
+      dev = atoi(argv[i]);
+  }
+
+  if(dev >= 0){
+    if(show(dev, verbose) < 0){
+      fprintf(2, "iostat: no disk %d\n", dev);
+      exit(1);
+    }
+    exit(0);
+  }
+  for(dev = 0; show(dev, verbose) == 0; dev++)
+    ;
+  exit(0);
+}
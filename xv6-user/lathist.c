@@ -0,0 +1,24 @@
+// Helpers for the latency histograms of blkctl(), shared by
+// diskpoll and iostat.
+
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/iostat.h"
+#include "xv6-user/user.h"
+
+// Upper bound (us) of the histogram bucket holding the pct-th percentile.
+uint64
+percentile(struct lathist *h, int pct)
+{
+  uint64 want, seen = 0;
+
+  if(h->count == 0)
+    return 0;
+  want = (h->count * pct + 99) / 100;
+  for(int i = 0; i < NLATBKT; i++){
+    seen += h->bkt[i];
+    if(seen >= want)
+      return 2UL << i;
+  }
+  return 2UL << (NLATBKT - 1);
+}
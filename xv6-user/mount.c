@@ -0,0 +1,26 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/iostat.h"
+#include "xv6-user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct blkinfo info;
+
+  if(argc == 1){
+    // list the block devices
+    for(int dev = 0; blkctl(dev, BLK_INFO, (uint64)&info) == 0; dev++)
+      printf("disk%d\t%s\t%d sectors\n", dev, info.name, (int)info.capacity);
+    exit(0);
+  }
+  if(argc != 3){
+    fprintf(2, "Usage: mount [disk dir]\n");
+    exit(1);
+  }
+  if(mount(atoi(argv[1]), argv[2]) < 0){
+    fprintf(2, "mount: cannot mount disk%s on %s\n", argv[1], argv[2]);
+    exit(1);
+  }
+  exit(0);
+}
@@ -1,19 +1,295 @@
 #include "kernel/include/types.h"
 #include "kernel/include/stat.h"
+#include "kernel/include/param.h"
 #include "xv6-user/user.h"
 
 #include <stdarg.h>
 
+// Buffered streams. Each file descriptor can have one, iob[fd],
+// reading or writing through its buffer of BUFSIZ bytes:
+//
+//   _IOFBF  output goes out when the buffer fills, input comes in
+//           a buffer at a time;
+//   _IOLBF  as _IOFBF, and output also goes out at each newline;
+//   _IONBF  output goes out at the end of each call, input comes
+//           in a byte at a time.
+//
+// stdin and stdout are line buffered if they are the console and
+// otherwise stdout is fully buffered and stdin unbuffered, since
+// the children of sh share its offset in the file. stderr is
+// unbuffered. fprintf() and printf() go through the stream of
+// their fd, or, for an fd without one, a buffer of their own, so
+// that they cost one write() a call instead of one a character.
+//
+// All buffers are flushed by exit(), and before fork(), exec()
+// and spawn() copy or drop them (see ulib.c); reading a line from
+// stdin flushes stdout, for prompts without a newline.
+
+#define S_READ          1
+#define S_WRITE         2
+#define S_UNSET         -1      // mode: decide on first use
+
+struct iobuf {
+  int fd;
+  int flags;                    // S_READ or S_WRITE, 0 if unused
+  int mode;
+  int n;                        // bytes in buf
+  int pos;                      // next byte of input in buf
+  char buf[BUFSIZ];
+};
+
+static FILE iob[NOFILE] = {
+  [0] { 0, S_READ, S_UNSET },
+  [1] { 1, S_WRITE, S_UNSET },
+  [2] { 2, S_WRITE, _IONBF },
+};
+
+FILE *stdin = &iob[0];
+FILE *stdout = &iob[1];
+FILE *stderr = &iob[2];
+
 static char digits[] = "0123456789ABCDEF";
 
 static void
-putc(int fd, char c)
+flushall(void)
+{
+  fflush(0);
+}
+
+// Settle f's mode on first use.
+static void
+setup(FILE *f)
+{
+  struct stat st;
+
+  stdioflush = flushall;
+  if(f->mode != S_UNSET)
+    return;
+  if(fstat(f->fd, &st) == 0 && st.type == T_DEVICE)
+    f->mode = _IOLBF;
+  else
+    f->mode = f->flags == S_READ ? _IONBF : _IOFBF;
+}
+
+int
+fflush(FILE *f)
+{
+  int r = 0;
+
+  if(f == 0){
+    for(f = iob; f < &iob[NOFILE]; f++)
+      if(f->flags == S_WRITE && fflush(f) < 0)
+        r = EOF;
+    return r;
+  }
+  if(f->flags == S_WRITE && f->n > 0){
+    if(write(f->fd, f->buf, f->n) != f->n)
+      r = EOF;
+    f->n = 0;
+  }
+  return r;
+}
+
+int
+setvbuf(FILE *f, int mode)
+{
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+  fflush(f);
+  f->mode = mode;
+  return 0;
+}
+
+// Give f a stream on fd, for reading if mode starts with 'r' and
+// otherwise for writing. Returns it, or 0 if fd is bad or has one.
+FILE*
+fdopen(int fd, char *mode)
+{
+  FILE *f;
+
+  if(fd < 0 || fd >= NOFILE || iob[fd].flags)
+    return 0;
+  f = &iob[fd];
+  f->fd = fd;
+  f->flags = mode[0] == 'r' ? S_READ : S_WRITE;
+  f->mode = S_UNSET;
+  f->n = f->pos = 0;
+  return f;
+}
+
+// Open path for reading ("r"), writing from scratch ("w") or
+// appending ("a"), with a stream.
+FILE*
+fopen(char *path, char *mode)
+{
+  int fd, omode;
+  FILE *f;
+
+  if(mode[0] == 'r')
+    omode = O_RDONLY;
+  else if(mode[0] == 'w')
+    omode = O_WRONLY | O_CREATE | O_TRUNC;
+  else if(mode[0] == 'a')
+    omode = O_WRONLY | O_CREATE | O_APPEND;
+  else
+    return 0;
+  if((fd = open(path, omode)) < 0)
+    return 0;
+  if((f = fdopen(fd, mode)) == 0)
+    close(fd);
+  return f;
+}
+
+int
+fclose(FILE *f)
+{
+  int r = fflush(f);
+
+  f->flags = 0;
+  if(close(f->fd) < 0)
+    r = EOF;
+  return r;
+}
+
+// Add c to f's output, without the flush at the end of an
+// unbuffered call.
+static void
+putc(FILE *f, char c)
+{
+  f->buf[f->n++] = c;
+  if(f->n == BUFSIZ || (c == '\n' && f->mode == _IOLBF))
+    fflush(f);
+}
+
+int
+fputc(int c, FILE *f)
+{
+  if(f->flags != S_WRITE)
+    return EOF;
+  setup(f);
+  putc(f, c);
+  if(f->mode == _IONBF && fflush(f) < 0)
+    return EOF;
+  return (uchar)c;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  if(f->flags != S_WRITE)
+    return EOF;
+  setup(f);
+  while(*s)
+    putc(f, *s++);
+  if(f->mode == _IONBF)
+    return fflush(f);
+  return 0;
+}
+
+// Write n items of size bytes from p to f. Returns how many
+// went into the buffer or out.
+uint
+fwrite(const void *p, uint size, uint n, FILE *f)
+{
+  const char *s = p;
+  uint len = size * n, i;
+
+  if(f->flags != S_WRITE || len == 0)
+    return 0;
+  setup(f);
+  // too much to be worth copying
+  if(len >= BUFSIZ){
+    if(fflush(f) < 0 || write(f->fd, s, len) != len)
+      return 0;
+    return n;
+  }
+  for(i = 0; i < len; i++)
+    putc(f, s[i]);
+  if(f->mode == _IONBF && fflush(f) < 0)
+    return 0;
+  return n;
+}
+
+int
+fgetc(FILE *f)
 {
-  write(fd, &c, 1);
+  int n;
+  char c;
+
+  if(f->flags != S_READ)
+    return EOF;
+  setup(f);
+  if(f->pos == f->n){
+    if(stdout->mode == _IOLBF)
+      fflush(stdout);
+    if(f->mode == _IONBF){
+      if(read(f->fd, &c, 1) != 1)
+        return EOF;
+      return (uchar)c;
+    }
+    if((n = read(f->fd, f->buf, BUFSIZ)) <= 0)
+      return EOF;
+    f->n = n;
+    f->pos = 0;
+  }
+  return (uchar)f->buf[f->pos++];
+}
+
+// Read a line of at most max - 1 bytes, keeping its newline.
+// Returns buf, or 0 at end of file.
+char*
+fgets(char *buf, int max, FILE *f)
+{
+  int i, c;
+
+  for(i = 0; i + 1 < max; ){
+    if((c = fgetc(f)) == EOF)
+      break;
+    buf[i++] = c;
+    if(c == '\n')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+// Read up to n items of size bytes from f into p. Returns how
+// many whole ones it got.
+uint
+fread(void *p, uint size, uint n, FILE *f)
+{
+  char *d = p;
+  uint len = size * n, i;
+  int c;
+
+  if(size == 0)
+    return 0;
+  for(i = 0; i < len; i++){
+    if((c = fgetc(f)) == EOF)
+      break;
+    d[i] = c;
+  }
+  return i / size;
+}
+
+char*
+gets(char *buf, int max)
+{
+  int i, c;
+
+  for(i=0; i+1 < max; ){
+    if((c = fgetc(stdin)) == EOF)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return buf;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(FILE *f, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -35,21 +311,21 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(f, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(FILE *f, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(f, '0');
+  putc(f, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(f, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-vprintf(int fd, const char *fmt, va_list ap)
+// Print to the given stream. Only understands %d, %x, %p, %s.
+static void
+vfprintf(FILE *f, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
@@ -61,39 +337,60 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(f, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(f, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(f, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(f, va_arg(ap, int), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(f, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(f, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(f, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(f, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(f, '%');
+        putc(f, c);
       }
       state = 0;
     }
   }
 }
 
+// Print to the given fd, through its stream if it has one.
+void
+vprintf(int fd, const char *fmt, va_list ap)
+{
+  FILE *f, tmp;
+
+  if(fd >= 0 && fd < NOFILE && iob[fd].flags == S_WRITE){
+    f = &iob[fd];
+    setup(f);
+  } else {
+    f = &tmp;
+    f->fd = fd;
+    f->flags = S_WRITE;
+    f->mode = _IONBF;
+    f->n = 0;
+  }
+  vfprintf(f, fmt, ap);
+  if(f->mode == _IONBF)
+    fflush(f);
+}
+
 void
 fprintf(int fd, const char *fmt, ...)
 {
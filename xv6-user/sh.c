@@ -14,6 +14,7 @@
 
 #define NENVS 16
 #define MAXARGS 10
+#define ENVPATH 128  // an exported directory, a slash and a command
 
 struct env{
   char name[32];
@@ -125,6 +126,21 @@ export(char *argv[])
   return 0;
 }
 
+// Build in path, of ENVPATH bytes, the name of cmd in the
+// directory of exported var i. Returns 0, or -1 if too long.
+int
+envpath(char *path, int i, char *cmd)
+{
+  int n = strlen(envs[i].value);
+
+  if(n + 1 + strlen(cmd) + 1 > ENVPATH)
+    return -1;
+  strcpy(path, envs[i].value);
+  path[n] = '/';
+  strcpy(path + n + 1, cmd);
+  return 0;
+}
+
 int
 replace(char *buf)
 {
@@ -179,19 +195,11 @@ runcmd(struct cmd *cmd)
     exec(ecmd->argv[0], ecmd->argv);
 
     int i;
-    char env_cmd[64];
+    char env_cmd[ENVPATH];
     for(i=0; i<nenv; i++)
     {
-      char *s_tmp = env_cmd;
-      char *d_tmp = envs[i].value;
-      while((*s_tmp = *d_tmp++))
-        s_tmp++;
-      *s_tmp++ = '/';
-      d_tmp = ecmd->argv[0];
-      while((*s_tmp++ = *d_tmp++))
-        ;
-
-      exec(env_cmd, ecmd->argv);
+      if(envpath(env_cmd, i, ecmd->argv[0]) == 0)
+        exec(env_cmd, ecmd->argv);
     }
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
     break;
@@ -247,6 +255,26 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Start ecmd as a child with spawn(), trying the exported
+// directories the way runcmd() does. Returns its pid, or -1.
+int
+spawncmd(struct execcmd *ecmd)
+{
+  int i, pid;
+  char env_cmd[ENVPATH];
+
+  if((pid = spawn(ecmd->argv[0], ecmd->argv)) >= 0)
+    return pid;
+  for(i=0; i<nenv; i++)
+  {
+    if(envpath(env_cmd, i, ecmd->argv[0]) == 0 &&
+       (pid = spawn(env_cmd, ecmd->argv)) >= 0)
+      return pid;
+  }
+  fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+  return -1;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -337,9 +365,16 @@ main(void)
         free(cmd);
         continue;
       }
-      else if(fork1() == 0) 
-        runcmd(cmd);
-      wait(0);
+      else if(cmd->type == EXEC){
+        // Nothing to set up in a child first, so don't copy the shell.
+        if(spawncmd(ecmd) >= 0)
+          wait(0);
+      }
+      else{
+        if(fork1() == 0)
+          runcmd(cmd);
+        wait(0);
+      }
       free(cmd);
     }
   }
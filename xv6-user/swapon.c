@@ -0,0 +1,38 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "xv6-user/user.h"
+
+char zeros[4096];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, kb, i;
+
+  if(argc < 2 || argc > 3){
+    fprintf(2, "usage: swapon file [size-in-KB]\n");
+    exit(1);
+  }
+  // with a size, make the file first: swap slots are written
+  // in place, so all of its clusters must exist
+  if(argc == 3){
+    kb = atoi(argv[2]);
+    if(kb < 4 || (fd = open(argv[1], O_CREATE | O_WRONLY | O_TRUNC)) < 0){
+      fprintf(2, "swapon: cannot create %s\n", argv[1]);
+      exit(1);
+    }
+    for(i = 0; i < kb / 4; i++){
+      if(write(fd, zeros, sizeof(zeros)) != sizeof(zeros)){
+        fprintf(2, "swapon: %s: write failed\n", argv[1]);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  if(swapon(argv[1]) < 0){
+    fprintf(2, "swapon: %s failed\n", argv[1]);
+    exit(1);
+  }
+  exit(0);
+}
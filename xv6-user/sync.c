@@ -0,0 +1,13 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+int
+main(void)
+{
+  if(sync() < 0){
+    fprintf(2, "sync: failed\n");
+    exit(1);
+  }
+  exit(0);
+}
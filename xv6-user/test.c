@@ -11,6 +11,13 @@ int main()
     } else {
         printf("memory left: %d KB\n", info.freemem >> 10);
         printf("process amount: %d\n", info.nproc);
+        printf("free blocks:");
+        for (int i = 0; i < NORDER; i++) {
+            printf(" %d", info.nfree[i]);
+        }
+        printf(" (by order, 4 KB << order)\n");
+        printf("swap: %d KB of %d KB used, %d pages in, %d out\n",
+               info.swapused >> 10, info.swapsize >> 10, info.swapins, info.swapouts);
     }
     exit(0);
 }
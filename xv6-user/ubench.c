@@ -0,0 +1,163 @@
+// Time ulib's string and memory routines against plain byte
+// loops like the ones they replaced. uptime() only counts timer
+// interrupts, so each runs for a few ticks and the result is
+// given as KB per tick, with the speedup over the byte loop.
+
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+#define TICKS   2               // ticks to run each routine for
+#define BATCH   64              // calls between looks at the clock
+
+char a[4096 + 64], b[4096 + 64];
+volatile int sink;
+
+static void
+bytememset(char *dst, int c, int n)
+{
+  while(n-- > 0)
+    *dst++ = c;
+}
+
+static void
+bytememmove(char *dst, const char *src, int n)
+{
+  while(n-- > 0)
+    *dst++ = *src++;
+}
+
+static int
+bytememcmp(const char *p, const char *q, int n)
+{
+  for(; n > 0; n--, p++, q++)
+    if(*p != *q)
+      return (uchar)*p - (uchar)*q;
+  return 0;
+}
+
+static int
+bytestrlen(const char *s)
+{
+  int n;
+
+  for(n = 0; s[n]; n++)
+    ;
+  return n;
+}
+
+static int
+bytestrcmp(const char *p, const char *q)
+{
+  while(*p && *p == *q)
+    p++, q++;
+  return (uchar)*p - (uchar)*q;
+}
+
+static char*
+bytestrchr(const char *s, char c)
+{
+  for(; *s; s++)
+    if(*s == c)
+      return (char*)s;
+  return 0;
+}
+
+enum { MEMSET, MEMMOVE, MEMCMP, STRLEN, STRCMP, STRCHR, NOP };
+
+static char *names[] = {
+  [MEMSET]  "memset",
+  [MEMMOVE] "memmove",
+  [MEMCMP]  "memcmp",
+  [STRLEN]  "strlen",
+  [STRCMP]  "strcmp",
+  [STRCHR]  "strchr",
+};
+
+// One call of op on n bytes at a + off and b + off, the ulib
+// one or the byte loop.
+static void
+call(int op, int bytewise, int n, int off)
+{
+  char *p = a + off, *q = b + off;
+
+  switch(op){
+  case MEMSET:
+    if(bytewise)
+      bytememset(p, 'x', n);
+    else
+      memset(p, 'x', n);
+    break;
+  case MEMMOVE:
+    if(bytewise)
+      bytememmove(p, q, n);
+    else
+      memmove(p, q, n);
+    break;
+  case MEMCMP:
+    sink = bytewise ? bytememcmp(p, q, n) : memcmp(p, q, n);
+    break;
+  case STRLEN:
+    sink = bytewise ? bytestrlen(p) : strlen(p);
+    break;
+  case STRCMP:
+    sink = bytewise ? bytestrcmp(p, q) : strcmp(p, q);
+    break;
+  case STRCHR:
+    sink = (bytewise ? bytestrchr(p, '!') : strchr(p, '!')) != 0;
+    break;
+  }
+}
+
+// Bytes of op done per tick.
+static uint64
+rate(int op, int bytewise, int n, int off)
+{
+  uint64 calls = 0;
+  int start, t;
+
+  // set up strings of n bytes, equal in a and b
+  memset(a, 'y', sizeof(a));
+  memset(b, 'y', sizeof(b));
+  a[off + n] = b[off + n] = 0;
+
+  // start on a tick boundary
+  for(start = uptime(); (t = uptime()) == start; )
+    ;
+  start = t;
+  do {
+    for(int i = 0; i < BATCH; i++)
+      call(op, bytewise, n, off);
+    calls += BATCH;
+  } while(uptime() - start < TICKS);
+  return calls * n / TICKS;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int sizes[] = { 16, 256, 4096 };
+  uint64 word, byte;
+  int op, i, off;
+
+  if(argc > 2){
+    fprintf(2, "usage: ubench [routine]\n");
+    exit(1);
+  }
+  printf("routine\tbytes\toffset\tKB/tick\tbytewise\tspeedup\n");
+  for(op = 0; op < NOP; op++){
+    if(argc == 2 && strcmp(argv[1], names[op]) != 0)
+      continue;
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+      for(off = 0; off < 8; off += 5){
+        word = rate(op, 0, sizes[i], off);
+        if((byte = rate(op, 1, sizes[i], off)) == 0)
+          byte = 1;
+        printf("%s\t%d\t%d\t%d\t%d\t\t%d.%dx\n", names[op], sizes[i], off,
+               (int)(word >> 10), (int)(byte >> 10),
+               (int)(word / byte), (int)(word * 10 / byte % 10));
+      }
+    }
+  }
+  exit(0);
+}
@@ -3,6 +3,19 @@
 #include "kernel/include/fcntl.h"
 #include "xv6-user/user.h"
 
+// The string and memory routines work a 64-bit word at a time
+// wherever the alignment of their pointers allows, as the
+// kernel's do. strlen(), strchr(), strcmp() and strncmp() find
+// the end of a string with HASZERO(), which is nonzero if any
+// byte of a word is; an aligned word never straddles a page, so
+// reading all of the one the terminator is in is safe.
+
+#define WSIZE   sizeof(uint64)
+#define WMASK   (WSIZE - 1)
+#define ONES    0x0101010101010101UL
+#define HIGHS   0x8080808080808080UL
+#define HASZERO(w)      (((w) - ONES) & ~(w) & HIGHS)
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -29,57 +42,110 @@ strcat(char *s, const char *t)
 int
 strcmp(const char *p, const char *q)
 {
+  const uint64 *wp, *wq;
+
+  if((((uint64)p ^ (uint64)q) & WMASK) == 0){
+    for(; (uint64)p & WMASK; p++, q++){
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+    }
+    // the first word that differs or ends the string is left
+    // for the loop below
+    wp = (const uint64 *) p;
+    wq = (const uint64 *) q;
+    while(*wp == *wq && !HASZERO(*wp))
+      wp++, wq++;
+    p = (const char *) wp;
+    q = (const char *) wq;
+  }
   while(*p && *p == *q)
     p++, q++;
   return (uchar)*p - (uchar)*q;
 }
 
+int
+strncmp(const char *p, const char *q, uint n)
+{
+  const uint64 *wp, *wq;
+
+  if((((uint64)p ^ (uint64)q) & WMASK) == 0){
+    for(; n > 0 && ((uint64)p & WMASK); n--, p++, q++){
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+    }
+    wp = (const uint64 *) p;
+    wq = (const uint64 *) q;
+    for(; n >= WSIZE && *wp == *wq && !HASZERO(*wp); n -= WSIZE)
+      wp++, wq++;
+    p = (const char *) wp;
+    q = (const char *) wq;
+  }
+  while(n > 0 && *p && *p == *q)
+    n--, p++, q++;
+  if(n == 0)
+    return 0;
+  return (uchar)*p - (uchar)*q;
+}
+
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p = s;
+  const uint64 *w;
 
-  for(n = 0; s[n]; n++)
+  for(; (uint64)p & WMASK; p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (const uint64 *) p; !HASZERO(*w); w++)
+    ;
+  for(p = (const char *) w; *p; p++)
     ;
-  return n;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *cdst = (uchar *) dst;
+  uint64 *wdst, w;
+
+  for(; n > 0 && ((uint64)cdst & WMASK); n--)
+    *cdst++ = c;
+  if(n >= WSIZE){
+    w = (uchar)c * ONES;
+    wdst = (uint64 *) cdst;
+    for(; n >= 8 * WSIZE; n -= 8 * WSIZE, wdst += 8){
+      wdst[0] = w; wdst[1] = w; wdst[2] = w; wdst[3] = w;
+      wdst[4] = w; wdst[5] = w; wdst[6] = w; wdst[7] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wdst++ = w;
+    cdst = (uchar *) wdst;
   }
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
 char*
 strchr(const char *s, char c)
 {
-  for(; *s; s++)
+  const uint64 *w;
+  uint64 cs = (uchar)c * ONES;
+
+  for(; (uint64)s & WMASK; s++){
     if(*s == c)
       return (char*)s;
-  return 0;
-}
-
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
+    if(*s == 0)
+      return 0;
   }
-  buf[i] = '\0';
-  return buf;
+  // stop at the word holding either c or the end
+  for(w = (const uint64 *) s; !HASZERO(*w) && !HASZERO(*w ^ cs); w++)
+    ;
+  for(s = (const char *) w; *s; s++)
+    if(*s == c)
+      return (char*)s;
+  return c == 0 ? (char*)s : 0;
 }
 
 int
@@ -116,15 +182,53 @@ memmove(void *vdst, const void *vsrc, int n)
 {
   char *dst;
   const char *src;
+  const uint64 *ws;
+  uint64 *wd;
+  int aligned;
 
+  // n is signed: keep a negative count out of the word loops,
+  // which compare it unsigned
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
+  aligned = (((uint64)src ^ (uint64)dst) & WMASK) == 0;
   if (src > dst) {
+    if(aligned){
+      for(; n > 0 && ((uint64)dst & WMASK); n--)
+        *dst++ = *src++;
+      ws = (const uint64 *) src;
+      wd = (uint64 *) dst;
+      for(; n >= 8 * WSIZE; n -= 8 * WSIZE, ws += 8, wd += 8){
+        wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+        wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      src = (const char *) ws;
+      dst = (char *) wd;
+    }
     while(n-- > 0)
       *dst++ = *src++;
   } else {
     dst += n;
     src += n;
+    if(aligned){
+      for(; n > 0 && ((uint64)dst & WMASK); n--)
+        *--dst = *--src;
+      ws = (const uint64 *) src;
+      wd = (uint64 *) dst;
+      for(; n >= 8 * WSIZE; n -= 8 * WSIZE){
+        ws -= 8;
+        wd -= 8;
+        wd[7] = ws[7]; wd[6] = ws[6]; wd[5] = ws[5]; wd[4] = ws[4];
+        wd[3] = ws[3]; wd[2] = ws[2]; wd[1] = ws[1]; wd[0] = ws[0];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *--wd = *--ws;
+      src = (const char *) ws;
+      dst = (char *) wd;
+    }
     while(n-- > 0)
       *--dst = *--src;
   }
@@ -134,7 +238,16 @@ memmove(void *vdst, const void *vsrc, int n)
 int
 memcmp(const void *s1, const void *s2, uint n)
 {
-  const char *p1 = s1, *p2 = s2;
+  const uchar *p1 = s1, *p2 = s2;
+
+  if((((uint64)p1 ^ (uint64)p2) & WMASK) == 0){
+    for(; n > 0 && ((uint64)p1 & WMASK); n--, p1++, p2++){
+      if(*p1 != *p2)
+        return *p1 - *p2;
+    }
+    for(; n >= WSIZE && *(uint64 *)p1 == *(uint64 *)p2; n -= WSIZE)
+      p1 += WSIZE, p2 += WSIZE;
+  }
   while (n-- > 0) {
     if (*p1 != *p2) {
       return *p1 - *p2;
@@ -150,3 +263,38 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Set by printf.c once its streams are in use, to flush them.
+void (*stdioflush)(void);
+
+int
+fork(void)
+{
+  if(stdioflush)
+    stdioflush();
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdioflush)
+    stdioflush();
+  _exit(status);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(stdioflush)
+    stdioflush();
+  return _exec(path, argv);
+}
+
+int
+spawn(char *path, char **argv)
+{
+  if(stdioflush)
+    stdioflush();
+  return _spawn(path, argv);
+}
@@ -3,8 +3,20 @@
 #include "xv6-user/user.h"
 #include "kernel/include/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Small requests, up to MAXSMALL bytes, are rounded up to one of
+// a few size classes, each with a free list of its own blocks,
+// so malloc() and free() of them just pop and push. A class that
+// runs dry carves a slab of new blocks out of a large block.
+//
+// Large requests, and slabs, come from the memory allocator by
+// Kernighan and Ritchie, The C programming Language, 2nd ed.
+// Section 8.7: a first-fit, address-ordered free list of blocks
+// that sbrk() grows and free() coalesces.
+//
+// Every block starts with a header. A large block's gives its
+// size in header units; a small block's has size 0, and ptr
+// pointing to its class while it is in use, or to the next free
+// block of the class while it isn't.
 
 typedef long Align;
 
@@ -18,15 +30,32 @@ union header {
 
 typedef union header Header;
 
+#define MAXSMALL        2048
+#define SLABMIN         4096    // bytes of blocks a slab carves, at least
+#define SLABBLK         4       // and blocks
+
+struct sizeclass {
+  uint size;                    // bytes a block holds
+  Header *free;
+};
+
+static struct sizeclass classes[] = {
+  { 16 }, { 32 }, { 48 }, { 64 }, { 96 }, { 128 }, { 192 }, { 256 },
+  { 384 }, { 512 }, { 768 }, { 1024 }, { 1536 }, { MAXSMALL },
+};
+
+// classof[(nbytes + 15) / 16] is the class for a small request
+static uchar classof[MAXSMALL / 16 + 1];
+
 static Header base;
 static Header *freep;
+static struct mallstat hstat;
 
-void
-free(void *ap)
+static void
+lfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -54,19 +83,19 @@ morecore(uint nu)
   p = sbrk(nu * sizeof(Header));
   if(p == (char*)-1)
     return 0;
+  hstat.heap += nu * sizeof(Header);
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  lfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// A large block of nunits header units, header included.
+static Header*
+lmalloc(uint nunits)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +110,94 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+// Fill c's free list from a new slab. Returns 0, or -1.
+static int
+refill(struct sizeclass *c)
+{
+  uint bunits = c->size / sizeof(Header) + 1;
+  uint n = SLABMIN / (bunits * sizeof(Header));
+  Header *slab, *bp;
+
+  if(n < SLABBLK)
+    n = SLABBLK;
+  if((slab = lmalloc(n * bunits + 1)) == 0)
+    return -1;
+  hstat.slabs += slab->s.size * sizeof(Header);
+  for(bp = slab + 1; n > 0; n--, bp += bunits){
+    bp->s.size = 0;
+    bp->s.ptr = c->free;
+    c->free = bp;
+  }
+  return 0;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  struct sizeclass *c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  hstat.nfree++;
+  if(bp->s.size == 0){
+    c = (struct sizeclass*)bp->s.ptr;
+    hstat.small -= c->size;
+    bp->s.ptr = c->free;
+    c->free = bp;
+  } else {
+    hstat.large -= (bp->s.size - 1) * sizeof(Header);
+    lfree(bp);
+  }
+}
+
+void*
+malloc(uint nbytes)
+{
+  struct sizeclass *c;
+  Header *p;
+  uint nunits;
+  int i, j;
+
+  if(nbytes <= MAXSMALL){
+    if(classof[MAXSMALL / 16] == 0){
+      for(i = j = 0; i <= MAXSMALL / 16; i++){
+        while(classes[j].size < i * 16)
+          j++;
+        classof[i] = j;
+      }
+    }
+    c = &classes[classof[(nbytes + 15) / 16]];
+    if(c->free == 0 && refill(c) < 0)
+      return 0;
+    p = c->free;
+    c->free = p->s.ptr;
+    p->s.ptr = (Header*)c;
+    hstat.small += c->size;
+    hstat.nmalloc++;
+    return (void*)(p + 1);
+  }
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((p = lmalloc(nunits)) == 0)
+    return 0;
+  hstat.large += (nunits - 1) * sizeof(Header);
+  hstat.nmalloc++;
+  return (void*)(p + 1);
+}
+
+// Fill in *st with the heap statistics.
+void
+mallstat(struct mallstat *st)
+{
+  *st = hstat;
+}
@@ -0,0 +1,22 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(argc < 2){
+    fprintf(2, "Usage: umount dirs...\n");
+    exit(1);
+  }
+
+  for(i = 1; i < argc; i++){
+    if(umount(argv[i]) < 0){
+      fprintf(2, "umount: %s not mounted or busy\n", argv[i]);
+    }
+  }
+
+  exit(0);
+}
@@ -5,6 +5,17 @@
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct lathist;
+
+// heap statistics from mallstat(), in bytes
+struct mallstat {
+  uint64 heap;                  // got from sbrk()
+  uint64 slabs;                 // carved into small blocks
+  uint64 small;                 // in use in small blocks
+  uint64 large;                 // in use in large blocks
+  uint64 nmalloc;               // malloc() calls that succeeded
+  uint64 nfree;                 // free() calls
+};
 
 // system calls
 int fork(void);
@@ -33,21 +44,66 @@ int remove(char *filename);
 int trace(int mask);
 int sysinfo(struct sysinfo *);
 int rename(char *old, char *new);
+int blkctl(int dev, int cmd, uint64 arg);
+int mount(int dev, char *path);
+int umount(char *path);
+int fsync(int fd);
+int sync(void);
+void* mmap(void *addr, uint64 len, int prot, int flags, int fd, uint64 off);
+int munmap(void *addr, uint64 len);
+int shmget(int key, uint64 size, int flags);
+void* shmat(int id);
+int shmdt(void *addr);
+int spawn(char *path, char **argv);
+int swapon(char *path);
+int membench(int op, int n, int dstoff, int srcoff, int reps);
 
 // ulib.c
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _exec(char*, char**);
+int _spawn(char *path, char **argv);
+extern void (*stdioflush)(void);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 char* strcat(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
-void fprintf(int, const char*, ...);
-void printf(const char*, ...);
-char* gets(char*, int max);
+int strncmp(const char*, const char*, uint);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void mallstat(struct mallstat*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// printf.c
+#define BUFSIZ  512
+#define EOF     (-1)
+#define _IOFBF  0               // fully buffered
+#define _IOLBF  1               // line buffered
+#define _IONBF  2               // unbuffered
+
+typedef struct iobuf FILE;
+extern FILE *stdin, *stdout, *stderr;
+
+void fprintf(int, const char*, ...);
+void printf(const char*, ...);
+char* gets(char*, int max);
+FILE* fopen(char *path, char *mode);
+FILE* fdopen(int fd, char *mode);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, int mode);
+int fputc(int c, FILE*);
+int fputs(const char*, FILE*);
+uint fwrite(const void*, uint size, uint n, FILE*);
+int fgetc(FILE*);
+char* fgets(char*, int max, FILE*);
+uint fread(void*, uint size, uint n, FILE*);
+
+// lathist.c, linked into diskpoll and iostat
+uint64 percentile(struct lathist*, int pct);
@@ -6,6 +6,11 @@
 #include "kernel/include/syscall.h"
 #include "kernel/include/memlayout.h"
 #include "kernel/include/riscv.h"
+#include "kernel/include/iostat.h"
+#include "kernel/include/sysinfo.h"
+#include "kernel/include/mman.h"
+#include "kernel/include/shm.h"
+#include "kernel/include/membench.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -681,6 +686,61 @@ exectest(char *s)
 
 }
 
+// spawn() runs echo with the parent's descriptors, and a failed
+// one leaves no child behind.
+void
+spawntest(char *s)
+{
+  int fd, save, xstatus, pid;
+  char *echoargv[] = { "echo", "OK", 0 };
+  char *noargv[] = { "no-such-program", 0 };
+  char buf[3];
+
+  if(spawn("no-such-program", noargv) >= 0){
+    printf("%s: spawn of a missing file succeeded\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+
+  remove("echo-ok");
+  fd = open("echo-ok", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  save = dup(1);
+  close(1);
+  dup(fd);
+  close(fd);
+  pid = spawn("echo", echoargv);
+  close(1);
+  dup(save);
+  close(save);
+  if(pid < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+
+  fd = open("echo-ok", O_RDONLY);
+  if(fd < 0 || read(fd, buf, 2) != 2){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("echo-ok");
+  if(buf[0] != 'O' || buf[1] != 'K'){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+}
+
 // simple fork and pipe read/write
 
 void
@@ -1959,6 +2019,62 @@ forktest(char *s)
   }
 }
 
+// fork a process holding most of free memory, which only fits
+// if the child shares the parent's pages copy-on-write, and check
+// that writes from either side, and from the kernel, stay private.
+void
+cowfork(char *s)
+{
+  struct sysinfo info;
+  uint64 sz, i;
+  int fds[2], pid, xstatus;
+  char *a;
+
+  if(sysinfo(&info) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  sz = PGROUNDDOWN(info.freemem / 3 * 2);
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sz; i += PGSIZE)
+    a[i] = 'p';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < sz; i += PGSIZE)
+      if(a[i] != 'p')
+        exit(1);
+    for(i = 0; i < sz / 4; i += PGSIZE)
+      a[i] = 'c';
+    // the kernel stores into a shared page
+    if(pipe(fds) < 0 || write(fds[1], "c", 1) != 1 || read(fds[0], a + sz - PGSIZE, 1) != 1)
+      exit(2);
+    if(a[0] != 'c' || a[sz - PGSIZE] != 'c')
+      exit(3);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed with %d\n", s, xstatus);
+    exit(1);
+  }
+  for(i = 0; i < sz; i += PGSIZE){
+    if(a[i] != 'p'){
+      printf("%s: parent's page %d changed\n", s, (int)(i / PGSIZE));
+      exit(1);
+    }
+  }
+  sbrk(-sz);
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2083,6 +2199,672 @@ sbrkmuch(char *s)
   }
 }
 
+// sbrk only reserves address space: growing past free memory
+// works, and memory is only used by the pages that get touched,
+// whether by the process or by the kernel on its behalf.
+void
+lazysbrk(char *s)
+{
+  struct sysinfo info;
+  uint64 free0, sz;
+  int fds[2];
+  char *a;
+
+  if(sysinfo(&info) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  free0 = info.freemem;
+  sz = PGROUNDUP(2 * free0);
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk of %d bytes failed\n", s, (int)sz);
+    exit(1);
+  }
+  if(a[PGSIZE] != 0){
+    printf("%s: untouched page isn't zero\n", s);
+    exit(1);
+  }
+  a[0] = 'a';
+  a[sz - 1] = 'z';
+  if(pipe(fds) < 0 || write(fds[1], "k", 1) != 1 || read(fds[0], a + sz / 2, 1) != 1 ||
+     a[sz / 2] != 'k'){
+    printf("%s: read into an untouched page failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(sysinfo(&info) < 0 || free0 - info.freemem > 16 * PGSIZE){
+    printf("%s: sbrk used %d KB for 4 pages\n", s, (int)((free0 - info.freemem) >> 10));
+    exit(1);
+  }
+  sbrk(-sz);
+}
+
+// mmap() of a file privately and shared, and of anonymous memory:
+// pages read the file, shared stores reach it on munmap(), private
+// ones don't, a child gets its own copy, and unmapped pages fault.
+void
+mmaptest(char *s)
+{
+  char chunk[208], *a;
+  int fd, i, pid, xstatus;
+  int fsz = sizeof(chunk) * 40;
+
+  for(i = 0; i < sizeof(chunk); i++)
+    chunk[i] = 'a' + i % 26;
+  fd = open("mmapfile", O_CREATE | O_RDWR);
+  for(i = 0; i < 40; i++){
+    if(write(fd, chunk, sizeof(chunk)) != sizeof(chunk)){
+      printf("%s: write mmapfile failed\n", s);
+      exit(1);
+    }
+  }
+
+  a = mmap(0, fsz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: private mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < fsz; i++){
+    if(a[i] != 'a' + i % 26){
+      printf("%s: private mapping byte %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  if(a[fsz] != 0){
+    printf("%s: bytes past the end of the file aren't zero\n", s);
+    exit(1);
+  }
+  a[0] = 'P';
+  if(munmap(a, fsz) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  a = mmap(0, fsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: shared mmap failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+  a[1] = 'S';
+  a[fsz - 1] = 'S';
+  if(munmap(a, fsz) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  for(i = 0; i < 40; i++){
+    if(read(fd, chunk, sizeof(chunk)) != sizeof(chunk) ||
+       (i == 0 && chunk[1] != 'S') || (i == 39 && chunk[sizeof(chunk) - 1] != 'S')){
+      printf("%s: shared stores didn't reach the file\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  remove("mmapfile");
+
+  // a file under a page, mapped shared by parent and child: each
+  // sees the other's stores, and both reach the file
+  fd = open("mmapfile", O_CREATE | O_RDWR);
+  if(write(fd, chunk, 100) != 100){
+    printf("%s: write short mmapfile failed\n", s);
+    exit(1);
+  }
+  a = mmap(0, 100, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: shared mmap of a short file failed\n", s);
+    exit(1);
+  }
+  a[0] = 'P';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[0] != 'P')
+      exit(1);
+    a[99] = 'C';
+    munmap(a, 100);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[99] != 'C'){
+    printf("%s: parent and child don't share a short file's page\n", s);
+    exit(1);
+  }
+  munmap(a, 100);
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, chunk, sizeof(chunk)) != 100 || chunk[0] != 'P' || chunk[99] != 'C'){
+    printf("%s: shared stores to a short file were lost\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("mmapfile");
+
+  a = mmap(0, 4 * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf("%s: anonymous mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++)
+    a[i * PGSIZE] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[3 * PGSIZE] != 'p')
+      exit(1);
+    a[0] = 'c';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[0] != 'p'){
+    printf("%s: child's anonymous memory wasn't its own\n", s);
+    exit(1);
+  }
+  // unmap the middle, splitting the region
+  if(munmap(a + PGSIZE, 2 * PGSIZE) < 0 || a[3 * PGSIZE] != 'p'){
+    printf("%s: partial munmap failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    a[PGSIZE] = 'x';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: store to an unmapped page succeeded\n", s);
+    exit(1);
+  }
+  munmap(a, 4 * PGSIZE);
+}
+
+// read() into and write() from mmap() regions, which lie above sz:
+// file to anonymous memory, a file mapping to a pipe, and back.
+void
+mmapio(char *s)
+{
+  char buf[64], *a, *m;
+  int fd, i, p[2];
+
+  fd = open("mmapio", O_CREATE | O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write mmapio failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  a = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  fd = open("mmapio", O_RDONLY);
+  m = mmap(0, sizeof(buf), PROT_READ, MAP_PRIVATE, fd, 0);
+  if(a == MAP_FAILED || m == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  // into the last bytes of the region
+  if(read(fd, a + PGSIZE - sizeof(buf), sizeof(buf)) != sizeof(buf) ||
+     memcmp(a + PGSIZE - sizeof(buf), buf, sizeof(buf)) != 0){
+    printf("%s: read into an anonymous mapping failed\n", s);
+    exit(1);
+  }
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(p[1], m, sizeof(buf)) != sizeof(buf) || read(p[0], a, sizeof(buf)) != sizeof(buf) ||
+     memcmp(a, buf, sizeof(buf)) != 0){
+    printf("%s: pipe I/O through mappings failed\n", s);
+    exit(1);
+  }
+  // but not past the end of a region, nor into a read-only one
+  if(write(p[1], m + PGSIZE - 8, 16) > 0){
+    printf("%s: write from past a mapping's end succeeded\n", s);
+    exit(1);
+  }
+  if(write(p[1], "x", 1) != 1 || read(p[0], m, 1) > 0 || m[0] != 'a'){
+    printf("%s: read into a read-only mapping succeeded\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  close(p[1]);
+  close(fd);
+  munmap(a, PGSIZE);
+  munmap(m, sizeof(buf));
+  remove("mmapio");
+}
+
+// A file truncated under a shared mapping stays truncated: munmap()
+// doesn't write the mapping's dirty pages back out past its end.
+void
+mmaptrunc(char *s)
+{
+  char buf[512], *a;
+  struct stat st;
+  int fd, fd2, i;
+  int fsz = 2 * PGSIZE;
+
+  memset(buf, 'a', sizeof(buf));
+  fd = open("mmaptrunc", O_CREATE | O_RDWR);
+  for(i = 0; i < fsz / sizeof(buf); i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write mmaptrunc failed\n", s);
+      exit(1);
+    }
+  }
+  a = mmap(0, fsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: shared mmap failed\n", s);
+    exit(1);
+  }
+  a[0] = 'S';
+  a[PGSIZE] = 'S';
+  if((fd2 = open("mmaptrunc", O_RDWR | O_TRUNC)) < 0){
+    printf("%s: open O_TRUNC failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  if(munmap(a, fsz) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != 0){
+    printf("%s: munmap wrote a truncated file back, size %d\n", s, (int)st.size);
+    exit(1);
+  }
+  close(fd);
+  remove("mmaptrunc");
+}
+
+// File data through the page cache: a partial overwrite keeps the
+// rest of its page, a shared mapping is the cached page itself, and
+// O_TRUNC leaves nothing of the old pages behind.
+void
+pagecache(char *s)
+{
+  char chunk[208], *a;
+  int fd, i, j, n;
+  int nchunk = 5 * PGSIZE / sizeof(chunk) + 1;
+
+  for(i = 0; i < sizeof(chunk); i++)
+    chunk[i] = 'a' + i % 26;
+  fd = open("pcfile", O_CREATE | O_RDWR);
+  for(i = 0; i < nchunk; i++){
+    if(write(fd, chunk, sizeof(chunk)) != sizeof(chunk)){
+      printf("%s: write pcfile failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // overwrite the start of the first page
+  fd = open("pcfile", O_RDWR);
+  memset(chunk, 'X', 100);
+  if(write(fd, chunk, 100) != 100){
+    printf("%s: overwrite failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcfile", O_RDONLY);
+  for(i = 0; i < nchunk; i++){
+    if(read(fd, chunk, sizeof(chunk)) != sizeof(chunk)){
+      printf("%s: read pcfile failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < sizeof(chunk); j++){
+      if(chunk[j] != (i == 0 && j < 100 ? 'X' : 'a' + j % 26)){
+        printf("%s: byte %d reads %c\n", s, i * (int)sizeof(chunk) + j, chunk[j]);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+
+  // a store to a shared mapping is at once what read() sees
+  fd = open("pcfile", O_RDWR);
+  a = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  a[0] = 'M';
+  if(read(fd, chunk, 1) != 1 || chunk[0] != 'M'){
+    printf("%s: read doesn't see the mapping's store\n", s);
+    exit(1);
+  }
+  munmap(a, PGSIZE);
+  close(fd);
+
+  fd = open("pcfile", O_RDWR | O_TRUNC);
+  if((n = read(fd, chunk, sizeof(chunk))) != 0){
+    printf("%s: truncated file reads %d bytes\n", s, n);
+    exit(1);
+  }
+  if(write(fd, "tr", 2) != 2){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcfile", O_RDONLY);
+  n = read(fd, chunk, sizeof(chunk));
+  close(fd);
+  if(n != 2 || chunk[0] != 't' || chunk[1] != 'r'){
+    printf("%s: truncated file reads back wrong\n", s);
+    exit(1);
+  }
+
+  // so is one to a page only partly in the file
+  fd = open("pcfile", O_RDWR);
+  a = mmap(0, 2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: mmap of a short file failed\n", s);
+    exit(1);
+  }
+  a[1] = 'R';
+  if(read(fd, chunk, sizeof(chunk)) != 2 || chunk[1] != 'R'){
+    printf("%s: read doesn't see the store to a partial page\n", s);
+    exit(1);
+  }
+  munmap(a, 2);
+  close(fd);
+  remove("pcfile");
+}
+
+// Shared-memory segments: a child's stores through an inherited
+// attachment and through its own attach by key reach the parent,
+// and the segment goes away with the last detach.
+void
+shmtest(char *s)
+{
+  int id, pid, xstatus;
+  char *a;
+
+  if((id = shmget(4242, 2 * PGSIZE, IPC_CREAT | IPC_EXCL)) < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  if((a = shmat(id)) == (char*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  a[0] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char *b;
+    if(a[0] != 'p')
+      exit(1);
+    a[1] = 'i';
+    if((b = shmat(shmget(4242, PGSIZE, 0))) == (char*)-1 || b == a)
+      exit(2);
+    b[PGSIZE] = 'k';
+    shmdt(b);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed with %d\n", s, xstatus);
+    exit(1);
+  }
+  if(a[1] != 'i' || a[PGSIZE] != 'k'){
+    printf("%s: child's stores didn't reach the parent\n", s);
+    exit(1);
+  }
+  if(shmdt(a + PGSIZE) == 0 || shmdt(a) < 0){
+    printf("%s: shmdt failed\n", s);
+    exit(1);
+  }
+  if(shmget(4242, PGSIZE, 0) >= 0){
+    printf("%s: segment outlived its last detach\n", s);
+    exit(1);
+  }
+}
+
+// With a swap file on, a child can touch more memory than is
+// free, and gets every page back as it left it. Runs last: the
+// swap file stays on.
+void
+swaptest(char *s)
+{
+  struct sysinfo info;
+  int fd, i, n, pid, xstatus;
+  uint64 outs;
+  char *a;
+
+  if(sysinfo(&info) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  if(info.swapsize == 0){
+    if((fd = open("swapfile", O_CREATE | O_WRONLY)) < 0){
+      printf("%s: create swapfile failed\n", s);
+      exit(1);
+    }
+    memset(buf, 0, sizeof(buf));
+    for(i = 0; i < 2 * 1024 * 1024 / BUFSZ; i++){
+      if(write(fd, buf, BUFSZ) != BUFSZ){
+        printf("%s: write swapfile failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+    if(swapon("swapfile") < 0 || sysinfo(&info) < 0 || info.swapsize == 0){
+      printf("%s: swapon failed\n", s);
+      exit(1);
+    }
+  }
+  outs = info.swapouts;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    n = info.freemem / PGSIZE + 64;
+    if((a = sbrk(n * PGSIZE)) == (char*)-1)
+      exit(1);
+    for(i = 0; i < n; i++)
+      *(int*)(a + i * PGSIZE) = i;
+    for(i = 0; i < n; i++){
+      if(*(int*)(a + i * PGSIZE) != i)
+        exit(2);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed with %d\n", s, xstatus);
+    exit(1);
+  }
+  if(sysinfo(&info) < 0 || info.swapouts == outs){
+    printf("%s: nothing was paged out\n", s);
+    exit(1);
+  }
+}
+
+// do the kernel's word-at-a-time memset(), memmove() and
+// memcmp() agree with byte loops, at every alignment and
+// around the sizes where they switch strategy?
+void
+memops(char *s)
+{
+  static int sizes[] = { 0, 1, 7, 8, 9, 63, 64, 65, 511, 4096 - 64 };
+  int op, i, dstoff, srcoff;
+
+  for(op = MB_MEMSET; op <= MB_MEMCMP; op++){
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+      for(dstoff = 0; dstoff < 8; dstoff++){
+        for(srcoff = 0; srcoff < 8; srcoff += op == MB_MEMSET ? 8 : 1){
+          if(membench(op, sizes[i], dstoff, srcoff, 1) < 0){
+            printf("%s: op %d, %d bytes, offsets %d %d: wrong result\n",
+                   s, op, sizes[i], dstoff, srcoff);
+            exit(1);
+          }
+        }
+      }
+    }
+  }
+  if(membench(MB_PAGEZERO, 0, 0, 0, 1) < 0 || membench(MB_PAGECOPY, 0, 0, 0, 1) < 0){
+    printf("%s: page routines: wrong result\n", s);
+    exit(1);
+  }
+  if(membench(MB_MEMMOVE, 4097, 0, 0, 1) >= 0 || membench(MB_MEMSET, 8, MB_MAXOFF, 0, 1) >= 0){
+    printf("%s: bad arguments accepted\n", s);
+    exit(1);
+  }
+}
+
+// ulib's word-at-a-time string routines, at every alignment
+// and with the end of the string anywhere in a word.
+void
+strops(char *s)
+{
+  static char a[64], b[64];
+  int i, off, n;
+
+  for(off = 0; off < 8; off++){
+    for(n = 0; n < 40; n++){
+      memset(a, 'x', sizeof(a));
+      a[off + n] = 0;
+      memmove(b + 7 - off % 8, a + off, n + 1);
+      if(strlen(a + off) != n || strcmp(a + off, b + 7 - off % 8) != 0 ||
+         strchr(a + off, 0) != a + off + n || strchr(a + off, 'y') != 0){
+        printf("%s: offset %d, length %d: wrong\n", s, off, n);
+        exit(1);
+      }
+      memmove(b + off, a + off, n + 1);
+      for(i = 0; i < n; i++){
+        b[off + i] = 'y';
+        if(strchr(b + off, 'y') != b + off + i || strcmp(a + off, b + off) >= 0 ||
+           strncmp(a + off, b + off, i) != 0 || strncmp(a + off, b + off, i + 1) >= 0 ||
+           memcmp(b + off, a + off, n) <= 0){
+          printf("%s: offset %d, length %d, at %d: wrong\n", s, off, n, i);
+          exit(1);
+        }
+        b[off + i] = 'x';
+      }
+      b[off + n] = 'x';
+      if(strcmp(a + off, b + off) >= 0 || strncmp(a + off, b + off, n) != 0){
+        printf("%s: offset %d, length %d: prefix wrong\n", s, off, n);
+        exit(1);
+      }
+    }
+  }
+}
+
+// size classes: a freed small block is the next one handed out
+// in its class, blocks don't overlap, and the statistics add up.
+void
+malloctest(char *s)
+{
+  static uint sizes[] = { 0, 1, 16, 17, 100, 500, 2048, 2049, 10000 };
+  char *p[sizeof(sizes) / sizeof(sizes[0])], *q;
+  struct mallstat before, after;
+  int i, j;
+
+  mallstat(&before);
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+    if((p[i] = malloc(sizes[i])) == 0){
+      printf("%s: malloc(%d) failed\n", s, sizes[i]);
+      exit(1);
+    }
+    memset(p[i], i, sizes[i]);
+  }
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+    for(j = 0; j < sizes[i]; j++){
+      if(p[i][j] != i){
+        printf("%s: block of %d bytes overwritten\n", s, sizes[i]);
+        exit(1);
+      }
+    }
+  }
+  free(p[4]);
+  if((q = malloc(sizes[4] - 3)) != p[4]){
+    printf("%s: freed block not reused\n", s);
+    exit(1);
+  }
+  p[4] = q;
+  mallstat(&after);
+  if(after.small < before.small + 16 + 32 + 128 + 512 + 2048 ||
+     after.large < before.large + 2049 + 10000 ||
+     after.nmalloc != before.nmalloc + 10 || after.nfree != before.nfree + 1){
+    printf("%s: statistics wrong\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    free(p[i]);
+  mallstat(&after);
+  if(after.small != before.small || after.large != before.large){
+    printf("%s: statistics wrong after free\n", s);
+    exit(1);
+  }
+}
+
+// buffered streams: what goes through one comes back, and fork()
+// doesn't leave a copy of unflushed output for the child to write.
+void
+stdiotest(char *s)
+{
+  FILE *f;
+  char line[64];
+  int i, pid, xstatus;
+
+  if((f = fopen("stdiotest", "w")) == 0){
+    printf("%s: fopen for writing failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 200; i++)
+    fputs("0123456789\n", f);
+  fputs("parent\n", f);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fputs("child\n", f);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(fclose(f) < 0){
+    printf("%s: fclose failed\n", s);
+    exit(1);
+  }
+
+  if((f = fopen("stdiotest", "r")) == 0){
+    printf("%s: fopen for reading failed\n", s);
+    exit(1);
+  }
+  for(i = 0; fgets(line, sizeof(line), f) != 0; i++){
+    if(i < 200 && strcmp(line, "0123456789\n") != 0){
+      printf("%s: line %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  fclose(f);
+  remove("stdiotest");
+  if(i != 202){
+    printf("%s: %d lines instead of 202\n", s, i);
+    exit(1);
+  }
+}
+
 // can we read the kernel's memory?
 void
 kernmem(char *s)
@@ -2535,6 +3317,65 @@ execout(char *s)
   exit(0);
 }
 
+// write through the write-back buffer cache, fsync, and read back.
+void
+wbcache(char *s)
+{
+  int fd, i, old;
+  enum { N=20 };
+
+  if((old = blkctl(ROOTDEV, BLK_WBCACHE, 1)) < 0){
+    printf("%s: blkctl BLK_WBCACHE failed\n", s);
+    exit(1);
+  }
+  fd = open("wbcache", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create wbcache failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, 'a' + i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  if(fsync(fd) < 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(blkctl(ROOTDEV, BLK_WBCACHE, old) != 1){
+    printf("%s: write-back cache was not on\n", s);
+    exit(1);
+  }
+
+  fd = open("wbcache", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open wbcache failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf("%s: read %d failed\n", s, i);
+      exit(1);
+    }
+    if(buf[0] != 'a' + i || buf[BSIZE-1] != 'a' + i){
+      printf("%s: block %d has wrong content\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(fsync(0) == 0){
+    printf("%s: fsync on the console succeeded\n", s);
+    exit(1);
+  }
+  if(remove("wbcache") < 0 || sync() < 0){
+    printf("%s: remove or sync failed\n", s);
+    exit(1);
+  }
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2675,6 +3516,7 @@ main(int argc, char *argv[])
     {fourfiles, "fourfiles"},
     {sharedfd, "sharedfd"},
     {exectest, "exectest"},
+    {spawntest, "spawntest"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
@@ -2687,6 +3529,14 @@ main(int argc, char *argv[])
     {stacktest, "stacktest"},
     {opentest, "opentest"},
     {writetest, "writetest"},
+    {wbcache, "wbcache"},
+    {cowfork, "cowfork"},
+    {lazysbrk, "lazysbrk"},
+    {mmaptest, "mmaptest"},
+    {mmapio, "mmapio"},
+    {mmaptrunc, "mmaptrunc"},
+    {pagecache, "pagecache"},
+    {shmtest, "shmtest"},
     {writebig, "writebig"},
     {createtest, "createtest"},
     {openiputtest, "openiput"},
@@ -2703,6 +3553,11 @@ main(int argc, char *argv[])
     {iref, "iref"},
     {forktest, "forktest"},
               // {bigdir, "bigdir"}, // slow
+    {memops, "memops"},
+    {strops, "strops"},
+    {malloctest, "malloctest"},
+    {stdiotest, "stdiotest"},
+    {swaptest, "swaptest"},
     { 0, 0},
   };
 
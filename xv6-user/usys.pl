@@ -6,24 +6,26 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/include/sysnum.h\"\n";
 
+# A stub named _name leaves name to a wrapper in ulib.c.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("fstat");
 entry("mkdir");
@@ -41,5 +43,18 @@ entry("remove");
 entry("trace");
 entry("sysinfo");
 entry("rename");
+entry("blkctl");
+entry("mount");
+entry("umount");
+entry("fsync");
+entry("sync");
+entry("mmap");
+entry("munmap");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("spawn", "_spawn");
+entry("swapon");
+entry("membench");
 
 entry("getppid");
@@ -0,0 +1,32 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/iostat.h"
+#include "xv6-user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int dev, on = -1, old;
+
+  if(argc < 2 || argc > 3){
+    fprintf(2, "usage: wbcache disk [on | off]\n");
+    exit(1);
+  }
+  dev = atoi(argv[1]);
+  if(argc == 3){
+    if(strcmp(argv[2], "on") == 0)
+      on = 1;
+    else if(strcmp(argv[2], "off") == 0)
+      on = 0;
+    else {
+      fprintf(2, "usage: wbcache disk [on | off]\n");
+      exit(1);
+    }
+  }
+  if((old = blkctl(dev, BLK_WBCACHE, on)) < 0){
+    fprintf(2, "wbcache: no disk %d\n", dev);
+    exit(1);
+  }
+  printf("disk%d: write-back cache %s\n", dev, (on < 0 ? old : on) ? "on" : "off");
+  exit(0);
+}